@@ -1,85 +1,246 @@
 #include "disassembler.h"
 
+#include <cstring>
+
+/*
+ * Text is built with a small cursor over a caller-supplied char buffer
+ * instead of std::string concatenation, so formatting never allocates.
+ * Hex comes from a 256 entry table of digit pairs, a byte at a time.
+ *
+ * Bulk disassembly goes one step further and formats every opcode once,
+ * into a table of "opcode | mnemonic\n" line tails. A line is then the
+ * address plus one fixed size copy, with no branching on the opcode.
+ */
+
+namespace {
+
+struct HexTable {
+    char pairs[256][2];
+
+    HexTable(const char* digits) {
+        for (unsigned int i = 0; i < 256; i++) {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0xF];
+        }
+    }
+};
+
+const HexTable UPPER_HEX("0123456789ABCDEF"); // operands
+const HexTable LOWER_HEX("0123456789abcdef"); // address and opcode columns, like the trace
+
+struct Writer {
+    char* at;
+
+    void text(const char* s, size_t n) { memcpy(at, s, n); at += n; }
+    template <size_t N> void text(const char (&s)[N]) { text(s, N - 1); }
+
+    void nibble(uint8_t v) { *at++ = UPPER_HEX.pairs[v & 0xF][1]; }
+    void byte(uint8_t v) { memcpy(at, UPPER_HEX.pairs[v], 2); at += 2; }
+    void address(uint16_t v) { nibble(v >> 8); byte(v & 0xFF); }
+    void column(uint8_t v) { memcpy(at, LOWER_HEX.pairs[v], 2); at += 2; }
+
+    // digits of a column address above the low four, if any
+    void addressHigh(uint32_t v) {
+        for (int shift = 28; shift >= 16; shift -= 4) {
+            if (v >> shift) {
+                *at++ = LOWER_HEX.pairs[(v >> shift) & 0xF][1];
+            }
+        }
+    }
+
+    // operand forms
+    void reg(uint8_t x) { *at++ = 'V'; nibble(x); }
+    void imm4(uint8_t n) { text("0x"); nibble(n); }
+    void imm8(uint8_t kk) { text("0x"); byte(kk); }
+    void imm12(uint16_t nnn) { text("0x"); address(nnn); }
+};
+
+struct LineTail {
+    char text[31]; // "opcode | mnemonic\n", padded
+    uint8_t length;
+};
+
+static_assert(sizeof(LineTail) == 32, "line tails are copied whole");
+
+/**
+ * Line tails for all 65536 opcodes, built on first use (2 MB).
+ */
+const LineTail* LineTails() {
+    static const std::vector<LineTail> tails = [] {
+        std::vector<LineTail> table(0x10000);
+        char line[DISASSEMBLY_LINE_MAX];
+
+        for (uint32_t opcode = 0; opcode < 0x10000; opcode++) {
+            // skip the 4 digit address and ": "
+            size_t length = Disassembler::formatLine(0, opcode, line) - 6;
+            memcpy(table[opcode].text, line + 6, length);
+            table[opcode].length = length;
+        }
+
+        return table;
+    }();
+
+    return tails.data();
+}
+
+} // namespace
+
 /**
  * Disassemble the instructions contained in the buffer
  */
 void Disassembler::disassemble(const std::vector<uint8_t>& buffer) {
+    std::vector<char> out;
+    disassemble(buffer.data(), buffer.size(), out);
+    fwrite(out.data(), 1, out.size(), stdout);
+}
+
+/**
+ * Disassemble a buffer into out, one line per instruction, replacing its
+ * contents. out keeps its capacity, so reusing it across files means no
+ * allocation once it has grown to the largest one.
+ * Returns the number of instructions, 0 if the buffer is not aligned.
+ */
+size_t Disassembler::disassemble(const uint8_t* data, size_t size, std::vector<char>& out) {
     // check alignment
-    if (buffer.size() % 2 != 0) {
+    if (size % 2 != 0) {
         std::cerr << "Error: File size is not even (program must be aligned)" << std::endl;
-        return;
+        out.clear();
+        return 0;
     }
 
-    // disassemble instructions in buffer
-    for (size_t i = 0; i < buffer.size(); i += 2) {
-        uint16_t opcode = (buffer[i] << 8) | buffer[i + 1]; // combine two bytes into 1, 16 bit instruction
-        std::string instr = decodeOpcode(opcode);
+    const LineTail* tails = LineTails();
+
+    size_t count = size / 2;
+    out.resize(count * DISASSEMBLY_LINE_MAX);
+
+    char* at = out.data();
+    for (size_t i = 0; i < size; i += 2) {
+        uint16_t opcode = (data[i] << 8) | data[i + 1]; // combine two bytes into 1, 16 bit instruction
 
-        // change to variable output stream later
-        std::cout << std::hex << std::setw(4) << std::setfill('0') << i // address
-                << ": " << std::hex << std::setw(4) << std::setfill('0') << opcode 
-                << " | " << instr << std::endl;
+        Writer w{at};
+        if (i > 0xFFFF) {
+            w.addressHigh(i);
+        }
+        w.column(i >> 8);
+        w.column(i);
+        w.text(": ");
+
+        const LineTail& tail = tails[opcode];
+        memcpy(w.at, tail.text, sizeof(tail.text));
+        at = w.at + tail.length;
     }
+
+    out.resize(at - out.data());
+    return count;
 }
 
 /**
  * Disassemble a single instruction given an opcode
  */
 std::string Disassembler::decodeOpcode(uint16_t opcode) {
+    char text[DISASSEMBLY_MNEMONIC_MAX];
+    return std::string(text, formatOpcode(opcode, text));
+}
+
+/**
+ * Write "address: opcode | mnemonic\n" to out.
+ * Returns the number of chars written.
+ */
+size_t Disassembler::formatLine(uint32_t address, uint16_t opcode, char* out) {
+    Writer w{out};
+
+    // at least four digits, more only past 64K
+    w.addressHigh(address);
+    w.column(address >> 8);
+    w.column(address);
+    w.text(": ");
+    w.column(opcode >> 8);
+    w.column(opcode);
+    w.text(" | ");
+    w.at += formatOpcode(opcode, w.at);
+    *w.at++ = '\n';
+
+    return w.at - out;
+}
+
+/**
+ * Write the mnemonic for an opcode to out, NUL terminated.
+ * Returns its length.
+ */
+size_t Disassembler::formatOpcode(uint16_t opcode, char* out) {
     uint8_t x = (opcode & 0x0F00u) >> 8u;
     uint8_t y = (opcode & 0x00F0u) >> 4u;
     uint8_t kk = (opcode & 0x00FF);
     uint8_t n = opcode & 0x000F;
     uint16_t nnn = opcode & 0x0FFF;
 
+    Writer w{out};
+
     switch (opcode & 0xF000) {
         case 0x0000:
-            if (opcode == 0x00E0) return "CLS";
-            if (opcode == 0x00EE) return "RET";
-            return "SYS " + std::to_string(nnn); // THESE ARE PRINTING IN DEC
-        case 0x1000: return "JP 0x" + std::to_string(nnn);
-        case 0x2000: return "CALL 0x" + std::to_string(nnn);
-        case 0x3000: return "SE V" + std::to_string(x) + ", 0x" + std::to_string(kk);
-        case 0x4000: return "SNE V" + std::to_string(x) + ", 0x" + std::to_string(kk);
-        case 0x5000: return "SE V" + std::to_string(x) + ", V" + std::to_string(y);
-        case 0x6000: return "LD V" + std::to_string(x) + ", 0x" + std::to_string(kk);
-        case 0x7000: return "ADD V" + std::to_string(x) + ", 0x" + std::to_string(kk);
+            if (opcode == 0x00E0) { w.text("CLS"); break; }
+            if (opcode == 0x00EE) { w.text("RET"); break; }
+            if ((opcode & 0xFFF0) == 0x00C0) { w.text("SCD "); w.imm4(n); break; }
+            if (opcode == 0x00FB) { w.text("SCR"); break; }
+            if (opcode == 0x00FC) { w.text("SCL"); break; }
+            if (opcode == 0x00FD) { w.text("EXIT"); break; }
+            if (opcode == 0x00FE) { w.text("LOW"); break; }
+            if (opcode == 0x00FF) { w.text("HIGH"); break; }
+            w.text("SYS "); w.imm12(nnn);
+            break;
+        case 0x1000: w.text("JP "); w.imm12(nnn); break;
+        case 0x2000: w.text("CALL "); w.imm12(nnn); break;
+        case 0x3000: w.text("SE "); w.reg(x); w.text(", "); w.imm8(kk); break;
+        case 0x4000: w.text("SNE "); w.reg(x); w.text(", "); w.imm8(kk); break;
+        case 0x5000: w.text("SE "); w.reg(x); w.text(", "); w.reg(y); break;
+        case 0x6000: w.text("LD "); w.reg(x); w.text(", "); w.imm8(kk); break;
+        case 0x7000: w.text("ADD "); w.reg(x); w.text(", "); w.imm8(kk); break;
         case 0x8000:
             switch (n) {
-                case 0x0: return "LD V" + std::to_string(x) + ", V" + std::to_string(y);
-                case 0x1: return "OR V" + std::to_string(x) + ", V" + std::to_string(y);
-                case 0x2: return "AND V" + std::to_string(x) + ", V" + std::to_string(y);
-                case 0x3: return "XOR V" + std::to_string(x) + ", V" + std::to_string(y);
-                case 0x4: return "ADD V" + std::to_string(x) + ", V" + std::to_string(y);
-                case 0x5: return "SUB V" + std::to_string(x) + ", V" + std::to_string(y);
-                case 0x6: return "SHR V" + std::to_string(x);
-                case 0x7: return "SUBN V" + std::to_string(x) + ", V" + std::to_string(y);
-                case 0xE: return "SHL V" + std::to_string(x);
-                default: return "UNKNOWN";
+                case 0x0: w.text("LD "); break;
+                case 0x1: w.text("OR "); break;
+                case 0x2: w.text("AND "); break;
+                case 0x3: w.text("XOR "); break;
+                case 0x4: w.text("ADD "); break;
+                case 0x5: w.text("SUB "); break;
+                case 0x6: w.text("SHR "); w.reg(x); break;
+                case 0x7: w.text("SUBN "); break;
+                case 0xE: w.text("SHL "); w.reg(x); break;
+                default: w.text("UNKNOWN"); break;
+            }
+            if (n <= 0x5 || n == 0x7) {
+                w.reg(x); w.text(", "); w.reg(y);
             }
-        case 0x9000: return "SNE V" + std::to_string(x) + ", V" + std::to_string(y);
-        case 0xA000: return "LD I, 0x" + std::to_string(nnn);
-        case 0xB000: return "JP V0, 0x" + std::to_string(nnn);
-        case 0xC000: return "RND V" + std::to_string(x) + ", 0x" + std::to_string(kk);
-        case 0xD000: return "DRW V" + std::to_string(x) + ", V" + std::to_string(y) + ", 0x" + std::to_string(n);
+            break;
+        case 0x9000: w.text("SNE "); w.reg(x); w.text(", "); w.reg(y); break;
+        case 0xA000: w.text("LD I, "); w.imm12(nnn); break;
+        case 0xB000: w.text("JP V0, "); w.imm12(nnn); break;
+        case 0xC000: w.text("RND "); w.reg(x); w.text(", "); w.imm8(kk); break;
+        case 0xD000: w.text("DRW "); w.reg(x); w.text(", "); w.reg(y); w.text(", "); w.imm4(n); break;
         case 0xE000:
-            if (kk == 0x9E) return "SKP V" + std::to_string(x);
-            if (kk == 0xA1) return "SKNP V" + std::to_string(x);
+            if (kk == 0x9E) { w.text("SKP "); w.reg(x); break; }
+            if (kk == 0xA1) { w.text("SKNP "); w.reg(x); break; }
+            w.text("UNKNOWN");
             break;
         case 0xF000:
             switch (kk) {
-                case 0x07: return "LD V" + std::to_string(x) + ", DT";
-                case 0x0A: return "LD V" + std::to_string(x) + ", K";
-                case 0x15: return "LD DT, V" + std::to_string(x);
-                case 0x18: return "LD ST, V" + std::to_string(x);
-                case 0x1E: return "ADD I, V" + std::to_string(x);
-                case 0x29: return "LD F, V" + std::to_string(x);
-                case 0x33: return "LD B, V" + std::to_string(x);
-                case 0x55: return "LD [I], V" + std::to_string(x);
-                case 0x65: return "LD V, [I]";
-                default: return "UNKNOWN";
+                case 0x07: w.text("LD "); w.reg(x); w.text(", DT"); break;
+                case 0x0A: w.text("LD "); w.reg(x); w.text(", K"); break;
+                case 0x15: w.text("LD DT, "); w.reg(x); break;
+                case 0x18: w.text("LD ST, "); w.reg(x); break;
+                case 0x1E: w.text("ADD I, "); w.reg(x); break;
+                case 0x29: w.text("LD F, "); w.reg(x); break;
+                case 0x30: w.text("LD HF, "); w.reg(x); break;
+                case 0x33: w.text("LD B, "); w.reg(x); break;
+                case 0x55: w.text("LD [I], "); w.reg(x); break;
+                case 0x65: w.text("LD "); w.reg(x); w.text(", [I]"); break;
+                case 0x75: w.text("LD R, "); w.reg(x); break;
+                case 0x85: w.text("LD "); w.reg(x); w.text(", R"); break;
+                default: w.text("UNKNOWN"); break;
             }
+            break;
     }
 
-    return "UNKNOWN";
-}
\ No newline at end of file
+    *w.at = '\0';
+    return w.at - out;
+}
@@ -4,15 +4,21 @@
 #include <string>
 #include <vector>
 
-#include <iostream> 
+#include <iostream>
 #include <iomanip>
 
+const size_t DISASSEMBLY_MNEMONIC_MAX = 24; // longest mnemonic plus NUL, with room to spare
+const size_t DISASSEMBLY_LINE_MAX = 40; // longest "address: opcode | mnemonic\n" line
+
 class Disassembler {
 public:
     void disassemble(const std::vector<uint8_t>& buffer);
-
-private:
+    size_t disassemble(const uint8_t* data, size_t size, std::vector<char>& out);
     std::string decodeOpcode(uint16_t opcode);
+
+    // allocation-free formatting, out must hold DISASSEMBLY_MNEMONIC_MAX / DISASSEMBLY_LINE_MAX chars
+    static size_t formatOpcode(uint16_t opcode, char* out);
+    static size_t formatLine(uint32_t address, uint16_t opcode, char* out);
 };
 
-#endif
\ No newline at end of file
+#endif
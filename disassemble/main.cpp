@@ -1,14 +1,163 @@
 #include "disassembler.h"
+#include "../src/threadpool.h"
 #include <stdio.h>
+#include <chrono>
 #include <fstream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Read-only mapping of a whole file.
+ */
+class MappedFile {
+public:
+    MappedFile(const char* filename) : data(nullptr), size(0), opened(false) {
+        int fd = open(filename, O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+
+        struct stat info;
+        if (fstat(fd, &info) == 0) {
+            opened = true;
+
+            // an empty file has nothing to map
+            if (info.st_size > 0) {
+                void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED) {
+                    madvise(mapped, info.st_size, MADV_SEQUENTIAL);
+                    data = static_cast<const uint8_t*>(mapped);
+                    size = info.st_size;
+                } else {
+                    opened = false;
+                }
+            }
+        }
+
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data != nullptr) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+
+    bool IsOpen() const { return opened; }
+
+    const uint8_t* data;
+    size_t size;
+
+private:
+    bool opened;
+};
+
+/**
+ * Disassemble many files across all cores.
+ * Each worker formats into its own reusable buffer; listings go to
+ * <dir>/<name>.asm, or to stdout in argument order without --output.
+ */
+static int RunBatch(const std::vector<std::string>& files, unsigned int threads, const std::string& outputDir) {
+    std::vector<std::vector<char>> listings(outputDir.empty() ? files.size() : 0);
+    std::vector<size_t> inputBytes(files.size(), 0);
+    std::vector<char> failed(files.size(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+
+        for (size_t i = 0; i < files.size(); i++) {
+            pool.Submit([&, i] {
+                MappedFile file(files[i].c_str());
+                if (!file.IsOpen()) {
+                    std::cerr << "Error: Unable to open file " << files[i] << std::endl;
+                    failed[i] = 1;
+                    return;
+                }
+                inputBytes[i] = file.size;
+
+                // an odd size is reported by the disassembler
+                if (outputDir.empty()) {
+                    failed[i] = Disassembler().disassemble(file.data, file.size, listings[i]) == 0 && file.size > 0;
+                    return;
+                }
+
+                thread_local std::vector<char> listing;
+                if (Disassembler().disassemble(file.data, file.size, listing) == 0 && file.size > 0) {
+                    failed[i] = 1;
+                    return;
+                }
+
+                std::string name = files[i].substr(files[i].find_last_of('/') + 1);
+                std::string path = outputDir + "/" + name + ".asm";
+
+                FILE* out = fopen(path.c_str(), "wb");
+                if (out == nullptr || fwrite(listing.data(), 1, listing.size(), out) != listing.size()) {
+                    std::cerr << "Error: Unable to write " << path << std::endl;
+                    failed[i] = 1;
+                }
+                if (out != nullptr) {
+                    fclose(out);
+                }
+            });
+        }
+
+        pool.Wait();
+        threads = pool.Size();
+    }
+
+    for (const std::vector<char>& listing : listings) {
+        fwrite(listing.data(), 1, listing.size(), stdout);
+    }
+    fflush(stdout);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    size_t total = 0;
+    size_t failures = 0;
+    for (size_t i = 0; i < files.size(); i++) {
+        total += inputBytes[i];
+        failures += failed[i];
+    }
+
+    fprintf(stderr, "%zu files, %.1f KB in %.1f ms on %u threads: %.1f MB/s\n", files.size() - failures,
+            total / 1024.0, ms, threads, ms > 0 ? total / (ms * 1000.0) : 0.0);
+
+    return failures == 0 ? 0 : 1;
+}
 
 int main (int argc, char* argv[]) {
     // check args
     if (argc < 2) {
         printf("Usage: %s <file>\n", argv[0]);
+        printf("       %s --batch [--threads=<n>] [--output=<dir>] <file>...\n", argv[0]);
         return 1;
     }
 
+    if (std::string(argv[1]) == "--batch") {
+        unsigned int threads = 0;
+        std::string outputDir;
+        std::vector<std::string> files;
+
+        for (int i = 2; i < argc; i++) {
+            std::string arg = argv[i];
+
+            if (arg.rfind("--threads=", 0) == 0) {
+                threads = std::stoi(arg.substr(10));
+            } else if (arg.rfind("--output=", 0) == 0) {
+                outputDir = arg.substr(9);
+            } else {
+                files.push_back(arg);
+            }
+        }
+
+        return RunBatch(files, threads, outputDir);
+    }
+
     // check input file
     std::ifstream inputFile(argv[1], std::ios::binary);
     if (!inputFile) {
@@ -18,7 +167,7 @@ int main (int argc, char* argv[]) {
 
     // read input file into buffer
     std::vector<uint8_t> buffer((std::istreambuf_iterator<char>(inputFile)), std::istreambuf_iterator<char>());
-    
+
     // close input file
     inputFile.close();
 
@@ -27,4 +176,4 @@ int main (int argc, char* argv[]) {
     disassembler.disassemble(buffer);
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,145 @@
+"""
+Batched CHIP-8 environments for reinforcement learning, over the C API
+in src/chip8env.h. Build the library first with `make env`.
+
+Observations and dones are passed as any writable, C-contiguous object
+supporting the buffer protocol (bytearray, array.array, numpy arrays, ...)
+and are written in place, without copies. Actions are only read, so they
+may also be read-only (bytes, a numpy view of a read-only array, ...);
+numpy arrays of another layout or integer type are converted first:
+
+    env = VectorEnv("roms/pong.ch8", 256, frame_skip=4)
+    obs = numpy.zeros((256, HEIGHT, WIDTH), numpy.uint8)
+    actions = numpy.zeros(256, numpy.uint16)  # bit k holds key k
+    env.reset(seed=1, observations=obs)
+    env.step(actions, observations=obs)
+
+Frames are only rewritten where they changed since they were last written
+to the same buffer, so don't modify observations in place.
+"""
+
+import ctypes
+import os
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+WIDTH = 64
+HEIGHT = 32
+FRAME_SIZE = WIDTH * HEIGHT
+
+
+class _Config(ctypes.Structure):
+    _fields_ = [
+        ("instructions_per_frame", ctypes.c_uint),
+        ("frame_skip", ctypes.c_uint),
+        ("threads", ctypes.c_uint),
+        ("jit", ctypes.c_int),
+    ]
+
+
+def _load(path):
+    lib = ctypes.CDLL(path)
+
+    lib.chip8_env_create.restype = ctypes.c_void_p
+    lib.chip8_env_create.argtypes = [ctypes.c_char_p, ctypes.c_uint, ctypes.POINTER(_Config)]
+    lib.chip8_env_destroy.restype = None
+    lib.chip8_env_destroy.argtypes = [ctypes.c_void_p]
+    lib.chip8_env_reset.argtypes = [ctypes.c_void_p, ctypes.c_uint64, ctypes.c_void_p]
+    lib.chip8_env_reset_one.argtypes = [ctypes.c_void_p, ctypes.c_uint, ctypes.c_uint64, ctypes.c_void_p]
+    lib.chip8_env_step.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+    lib.chip8_env_render.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+
+    return lib
+
+
+def _pointer(buffer, size, itemsize=1):
+    """Address of a writable buffer holding at least size items, or None."""
+    if buffer is None:
+        return None
+
+    view = memoryview(buffer)
+    if not view.c_contiguous or view.readonly:
+        raise ValueError("buffer must be writable and C-contiguous")
+    if view.nbytes < size * itemsize:
+        raise ValueError("buffer holds %d bytes, %d needed" % (view.nbytes, size * itemsize))
+
+    return ctypes.addressof(ctypes.c_char.from_buffer(view.cast("B")))
+
+
+def _input(buffer, size, itemsize):
+    """A (keep-alive, address) pair for a buffer only read, copied if needed."""
+    if buffer is None:
+        return None, None
+
+    if numpy is not None and isinstance(buffer, numpy.ndarray):
+        array = numpy.ascontiguousarray(buffer, dtype="u%d" % itemsize)
+        if array.size < size:
+            raise ValueError("array holds %d items, %d needed" % (array.size, size))
+        return array, ctypes.c_void_p(array.ctypes.data)
+
+    view = memoryview(buffer)
+    if not view.c_contiguous:
+        raise ValueError("buffer must be C-contiguous")
+    if view.nbytes < size * itemsize:
+        raise ValueError("buffer holds %d bytes, %d needed" % (view.nbytes, size * itemsize))
+
+    # from_buffer needs a writable buffer, a small copy takes read-only ones too
+    copy = (ctypes.c_char * view.nbytes).from_buffer_copy(view.cast("B"))
+    return copy, ctypes.c_void_p(ctypes.addressof(copy))
+
+
+def _check(result, call):
+    if result != 0:
+        raise RuntimeError("%s failed" % call)
+
+
+class VectorEnv:
+    def __init__(self, rom, count, instructions_per_frame=0, frame_skip=1, threads=0, jit=False,
+                 library=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "libchip8env.so")):
+        self._lib = _load(library)
+        config = _Config(instructions_per_frame, frame_skip, threads, 1 if jit else 0)
+
+        self._env = self._lib.chip8_env_create(os.fsencode(rom), count, ctypes.byref(config))
+        if not self._env:
+            raise RuntimeError("can't create environments for %s" % rom)
+
+        self.count = count
+
+    def close(self):
+        if self._env:
+            self._lib.chip8_env_destroy(self._env)
+            self._env = None
+
+    def __del__(self):
+        self.close()
+
+    def observation_buffer(self):
+        """A bytearray for count frames, for callers without numpy."""
+        return bytearray(self.count * FRAME_SIZE)
+
+    def reset(self, seed=0, observations=None):
+        _check(self._lib.chip8_env_reset(self._env, seed, _pointer(observations, self.count * FRAME_SIZE)),
+               "chip8_env_reset")
+        return observations
+
+    def reset_one(self, index, seed, observations=None):
+        if self._lib.chip8_env_reset_one(self._env, index, seed,
+                                         _pointer(observations, self.count * FRAME_SIZE)) != 0:
+            raise IndexError(index)
+        return observations
+
+    def step(self, actions, observations=None, dones=None):
+        """actions holds one uint16 key mask per environment."""
+        keep, pointer = _input(actions, self.count, 2)
+        _check(self._lib.chip8_env_step(self._env, pointer, _pointer(observations, self.count * FRAME_SIZE),
+                                        _pointer(dones, self.count)),
+               "chip8_env_step")
+        return observations, dones
+
+    def render(self, observations):
+        _check(self._lib.chip8_env_render(self._env, _pointer(observations, self.count * FRAME_SIZE)),
+               "chip8_env_render")
+        return observations
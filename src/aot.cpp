@@ -0,0 +1,138 @@
+#include "aot.h"
+
+/**
+ * Translated programs linked into this binary.
+ */
+static std::vector<const AotProgram*>& Registry() {
+    static std::vector<const AotProgram*> programs;
+    return programs;
+}
+
+Aot::Aot(Chip8& chip8, const AotProgram& program) : chip8(chip8), program(program), live(program.blockCount, false) {
+    for (unsigned int i = 0; i < MEMORY_SIZE; i++) {
+        entries[i] = nullptr;
+        covered[i] = false;
+        idleHeads[i] = false;
+    }
+
+    for (uint32_t b = 0; b < program.blockCount; b++) {
+        const AotBlock& block = program.blocks[b];
+
+        for (unsigned int address = block.start; address < block.end; address += INSTRUCTION_WIDTH) {
+            entries[address] = &block;
+        }
+        for (unsigned int i = block.start; i < block.end; i++) {
+            covered[i] = true;
+        }
+    }
+
+    Validate(START_ADDRESS, program.size);
+}
+
+/**
+ * Make a translated program available to SetEngine(ENGINE_AOT).
+ */
+void Aot::Register(const AotProgram* program) {
+    Registry().push_back(program);
+}
+
+/**
+ * Find the translation of the program in memory, if one was linked in.
+ * Where one ROM is a prefix of another, the longer one wins.
+ */
+const AotProgram* Aot::Find(const Chip8& chip8) {
+    const AotProgram* found = nullptr;
+
+    for (const AotProgram* program : Registry()) {
+        if (program->size <= MEMORY_SIZE - START_ADDRESS
+            && memcmp(&chip8.memory[START_ADDRESS], program->image, program->size) == 0
+            && (found == nullptr || program->size > found->size)) {
+            found = program;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Execute up to the given number of instructions.
+ * Returns the number of instructions executed.
+ */
+uint32_t Aot::Run(uint32_t instructions) {
+    Chip8State& s = chip8;
+    uint32_t remaining = instructions;
+
+    while (remaining > 0 && !chip8.halted) {
+        uint16_t address = chip8.pc;
+        const AotBlock* block = address < MEMORY_SIZE ? entries[address] : nullptr;
+
+        if (block == nullptr || !live[block - program.blocks]) {
+            chip8.Cycle();
+            remaining--;
+            continue;
+        }
+
+        // a polling loop that would spin to the end of the budget
+        if (idleHeads[address]) {
+            remaining -= chip8.SkipIdle(remaining);
+            if (remaining == 0) {
+                break;
+            }
+        }
+
+        remaining = block->run(chip8, s, remaining);
+    }
+
+    return instructions - remaining;
+}
+
+/**
+ * Called when memory is written. Blocks covering the written bytes are
+ * rechecked against the image, so they stop running once their code is
+ * changed and start again if it is changed back (e.g. by LoadState).
+ */
+void Aot::Invalidate(unsigned int address, unsigned int length) {
+    for (unsigned int i = address; i < address + length && i < MEMORY_SIZE; i++) {
+        if (covered[i]) {
+            Validate(address, length);
+            return;
+        }
+    }
+}
+
+/**
+ * Recheck the blocks overlapping a span of memory, and the idle loops
+ * that might start in it.
+ */
+void Aot::Validate(unsigned int address, unsigned int length) {
+    unsigned int end = address + length < MEMORY_SIZE ? address + length : MEMORY_SIZE;
+
+    for (uint32_t b = 0; b < program.blockCount; b++) {
+        const AotBlock& block = program.blocks[b];
+
+        if (block.start < end && block.end > address) {
+            live[b] = memcmp(&chip8.memory[block.start], &program.image[block.start - START_ADDRESS],
+                             block.end - block.start) == 0;
+        }
+    }
+
+    // an idle loop is a few instructions long and may start before the span
+    unsigned int reach = MAX_FUSED_LENGTH * INSTRUCTION_WIDTH - 1;
+    unsigned int start = address > reach ? address - reach : 0;
+
+    for (unsigned int i = start; i < end; i++) {
+        idleHeads[i] = entries[i] != nullptr && chip8.IdleLoopLength(i) != 0;
+    }
+}
+
+/**
+ * Run one instruction through its interpreter handler.
+ */
+void Aot::Execute(Chip8& chip8, uint16_t opcode) {
+    Chip8::Instruction instr;
+    chip8.Decode(opcode, instr);
+
+    chip8.instr = &instr;
+    chip8.opcode = opcode;
+    (chip8.*(instr.handler))();
+}
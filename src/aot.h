@@ -0,0 +1,84 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <cstdint>
+#include <vector>
+
+#include "chip8.h"
+
+/**
+ * Translated code for one block of a ROM. It can be entered at any of its
+ * instructions (s.pc) and runs until control leaves the block or the
+ * budget runs out. It stores pc on the way out and returns the budget left.
+ */
+typedef uint32_t (*AotBlockFunc)(Chip8& chip8, Chip8State& s, uint32_t budget);
+
+struct AotBlock {
+    uint16_t start; // first instruction
+    uint16_t end; // one past its last byte
+    AotBlockFunc run;
+};
+
+/**
+ * A ROM translated by chip8-aot. The generated source defines one and
+ * registers it at startup, so linking the source in is all it takes.
+ */
+struct AotProgram {
+    const char* name;
+    const uint8_t* image; // the ROM the code was translated from
+    uint32_t size;
+    const AotBlock* blocks;
+    uint32_t blockCount;
+};
+
+/*
+ * Helpers for generated code. Every instruction starts with AOT_STEP,
+ * which also makes it an exit point once the budget is spent.
+ */
+#define AOT_STEP(address) \
+    if (budget == 0) { s.pc = (address); return 0; } \
+    budget--
+
+#define AOT_EXIT(address) \
+    do { s.pc = (address); return budget; } while (0)
+
+/**
+ * Runs ROMs translated ahead of time.
+ * Blocks are only entered while memory still holds the bytes they were
+ * translated from; self-modified code, computed jumps to addresses the
+ * translator never saw and anything outside the ROM are interpreted one
+ * instruction at a time until pc reaches a translated block again.
+ */
+class Aot {
+public:
+    Aot(Chip8& chip8, const AotProgram& program);
+
+    static void Register(const AotProgram* program);
+    static const AotProgram* Find(const Chip8& chip8);
+
+    uint32_t Run(uint32_t instructions);
+    void Invalidate(unsigned int address, unsigned int length);
+
+    // for generated code: run one instruction through its interpreter handler
+    static void Execute(Chip8& chip8, uint16_t opcode);
+
+private:
+    void Validate(unsigned int address, unsigned int length);
+
+    Chip8& chip8;
+    const AotProgram& program;
+
+    const AotBlock* entries[MEMORY_SIZE]; // block holding the instruction at each address
+    bool covered[MEMORY_SIZE]; // byte is part of some block
+    bool idleHeads[MEMORY_SIZE]; // address starts an idle loop, fast-forwarded before entering
+    std::vector<bool> live; // per block, memory still matches the image
+};
+
+/**
+ * Registers a translated program from a static initializer.
+ */
+struct AotRegistration {
+    AotRegistration(const AotProgram* program) { Aot::Register(program); }
+};
+
+#endif
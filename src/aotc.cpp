@@ -0,0 +1,450 @@
+#include "aot.h"
+#include "../disassemble/disassembler.h"
+
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Ahead-of-time recompiler.
+ *
+ *     chip8-aot <ROM> <output.cpp>
+ *
+ * Walks the ROM's control flow from 0x200 and writes a C++ translation
+ * unit with one function per block. Linking that file into a binary makes
+ * SetEngine(ENGINE_AOT) available whenever the same ROM is loaded.
+ */
+
+const unsigned int AOT_MAX_BLOCK_INSTRUCTIONS = 256; // bounds what a code write takes offline
+
+/**
+ * Translates one ROM image into C++ source.
+ * Register ops, branches, calls and returns become plain C++ on the
+ * Chip8State fields, mirroring op.cpp statement for statement; anything
+ * that draws, scrolls, reads the RNG or may rewrite code calls the
+ * interpreter handler through Aot::Execute.
+ */
+class AotTranslator {
+public:
+    AotTranslator(const std::vector<uint8_t>& rom);
+
+    void Write(std::ostream& out, const std::string& source);
+
+    size_t GetBlockCount() const { return blocks.size(); }
+    size_t GetInstructionCount() const;
+
+private:
+    struct Block {
+        uint16_t start;
+        uint16_t end;
+    };
+
+    bool InImage(unsigned int address) const;
+    Chip8::Instruction Decode(unsigned int address) const;
+    static bool EndsBlock(const Chip8::Instruction& instr);
+
+    void Walk();
+    void Split();
+
+    void EmitBlock(std::ostream& out, const Block& block);
+    void EmitInstruction(std::ostream& out, const Block& block, uint16_t address, const Chip8::Instruction& instr);
+    void EmitJump(std::ostream& out, const Block& block, uint16_t target);
+
+    const std::vector<uint8_t>& rom;
+    std::unique_ptr<Chip8> chip8; // for its decoder
+
+    bool reachable[MEMORY_SIZE];
+    std::vector<Block> blocks;
+};
+
+static std::string Hex(unsigned int value, int digits) {
+    char text[16];
+    snprintf(text, sizeof(text), "%0*X", digits, value);
+    return text;
+}
+
+AotTranslator::AotTranslator(const std::vector<uint8_t>& rom) : rom(rom), chip8(new Chip8()) {
+    Walk();
+    Split();
+}
+
+size_t AotTranslator::GetInstructionCount() const {
+    size_t count = 0;
+    for (const Block& block : blocks) {
+        count += (block.end - block.start) / INSTRUCTION_WIDTH;
+    }
+    return count;
+}
+
+/**
+ * Check that a whole instruction at address comes from the ROM.
+ */
+bool AotTranslator::InImage(unsigned int address) const {
+    return address >= START_ADDRESS && address + 1 < START_ADDRESS + rom.size();
+}
+
+Chip8::Instruction AotTranslator::Decode(unsigned int address) const {
+    const uint8_t* at = &rom[address - START_ADDRESS];
+
+    Chip8::Instruction instr;
+    chip8->Decode((at[0] << 8u) | at[1], instr);
+    return instr;
+}
+
+/**
+ * Instructions after which execution never falls through.
+ */
+bool AotTranslator::EndsBlock(const Chip8::Instruction& instr) {
+    switch (instr.operation) {
+        case OPERATION_00EE:
+        case OPERATION_00FD:
+        case OPERATION_1nnn:
+        case OPERATION_2nnn:
+        case OPERATION_Bnnn:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * Mark every instruction reachable from 0x200 by static control flow.
+ * Computed jumps (Bnnn) are not followed, and calls are assumed to
+ * return to the instruction after them.
+ */
+void AotTranslator::Walk() {
+    for (unsigned int i = 0; i < MEMORY_SIZE; i++) {
+        reachable[i] = false;
+    }
+
+    std::vector<unsigned int> pending = {START_ADDRESS};
+
+    while (!pending.empty()) {
+        unsigned int address = pending.back();
+        pending.pop_back();
+
+        if (!InImage(address) || reachable[address]) {
+            continue;
+        }
+        reachable[address] = true;
+
+        Chip8::Instruction instr = Decode(address);
+        unsigned int next = address + INSTRUCTION_WIDTH;
+
+        switch (instr.operation) {
+            case OPERATION_00EE:
+            case OPERATION_00FD:
+            case OPERATION_Bnnn:
+                break;
+            case OPERATION_1nnn:
+                pending.push_back(instr.nnn);
+                break;
+            case OPERATION_2nnn:
+                pending.push_back(next);
+                pending.push_back(instr.nnn);
+                break;
+            case OPERATION_3xkk:
+            case OPERATION_4xkk:
+            case OPERATION_5xy0:
+            case OPERATION_9xy0:
+            case OPERATION_Ex9E:
+            case OPERATION_ExA1:
+                pending.push_back(next + INSTRUCTION_WIDTH);
+                pending.push_back(next);
+                break;
+            default:
+                pending.push_back(next);
+                break;
+        }
+    }
+}
+
+/**
+ * Group reachable instructions into blocks: runs of consecutive
+ * instructions, each ending where execution can't fall through.
+ * Every reachable instruction lands in exactly one block.
+ */
+void AotTranslator::Split() {
+    bool assigned[MEMORY_SIZE] = {};
+
+    for (unsigned int start = START_ADDRESS; start < MEMORY_SIZE; start++) {
+        if (!reachable[start] || assigned[start]) {
+            continue;
+        }
+
+        unsigned int address = start;
+        unsigned int count = 0;
+
+        while (address < MEMORY_SIZE && reachable[address] && !assigned[address] && count < AOT_MAX_BLOCK_INSTRUCTIONS) {
+            assigned[address] = true;
+            count++;
+
+            bool ends = EndsBlock(Decode(address));
+            address += INSTRUCTION_WIDTH;
+
+            if (ends) {
+                break;
+            }
+        }
+
+        blocks.push_back({static_cast<uint16_t>(start), static_cast<uint16_t>(address)});
+    }
+}
+
+/**
+ * Write the translation unit.
+ */
+void AotTranslator::Write(std::ostream& out, const std::string& source) {
+    out << "// Generated by chip8-aot from " << source << ", do not edit.\n"
+        << "// " << blocks.size() << " blocks, " << GetInstructionCount() << " instructions.\n"
+        << "\n"
+        << "#include \"aot.h\"\n"
+        << "\n"
+        << "namespace {\n"
+        << "\n";
+
+    for (const Block& block : blocks) {
+        EmitBlock(out, block);
+    }
+
+    out << "const uint8_t IMAGE[" << rom.size() << "] = {";
+    for (size_t i = 0; i < rom.size(); i++) {
+        out << (i % 16 == 0 ? "\n    " : " ") << "0x" << Hex(rom[i], 2) << ",";
+    }
+    out << "\n};\n\n";
+
+    out << "const AotBlock BLOCKS[] = {\n";
+    for (const Block& block : blocks) {
+        out << "    {0x" << Hex(block.start, 3) << ", 0x" << Hex(block.end, 3) << ", Block_" << Hex(block.start, 3) << "},\n";
+    }
+    out << "};\n\n";
+
+    std::string name = source.substr(source.find_last_of('/') + 1);
+
+    out << "const AotProgram PROGRAM = {\"" << name << "\", IMAGE, sizeof(IMAGE), BLOCKS, "
+        << blocks.size() << "};\n"
+        << "\n"
+        << "const AotRegistration REGISTRATION(&PROGRAM);\n"
+        << "\n"
+        << "} // namespace\n";
+}
+
+void AotTranslator::EmitBlock(std::ostream& out, const Block& block) {
+    std::string name = Hex(block.start, 3);
+
+    out << "uint32_t Block_" << name << "(Chip8& chip8, Chip8State& s, uint32_t budget) {\n"
+        << "    (void) chip8;\n"
+        << "\n"
+        << "    switch (s.pc) {\n";
+    for (unsigned int address = block.start; address < block.end; address += INSTRUCTION_WIDTH) {
+        out << "        case 0x" << Hex(address, 3) << ": goto L_" << Hex(address, 3) << ";\n";
+    }
+    out << "    }\n"
+        << "    return budget; // only entered at its own instructions\n"
+        << "\n";
+
+    for (unsigned int address = block.start; address < block.end; address += INSTRUCTION_WIDTH) {
+        EmitInstruction(out, block, address, Decode(address));
+    }
+
+    // ran off the end without a jump
+    if (!EndsBlock(Decode(block.end - INSTRUCTION_WIDTH))) {
+        out << "    AOT_EXIT(0x" << Hex(block.end, 3) << ");\n";
+    }
+
+    out << "}\n\n";
+}
+
+/**
+ * Continue at target: a goto within the block, otherwise back to Aot::Run.
+ */
+void AotTranslator::EmitJump(std::ostream& out, const Block& block, uint16_t target) {
+    if (target >= block.start && target < block.end && (target - block.start) % INSTRUCTION_WIDTH == 0) {
+        out << "goto L_" << Hex(target, 3) << ";";
+    } else {
+        out << "AOT_EXIT(0x" << Hex(target, 3) << ");";
+    }
+}
+
+void AotTranslator::EmitInstruction(std::ostream& out, const Block& block, uint16_t address, const Chip8::Instruction& instr) {
+    char mnemonic[DISASSEMBLY_MNEMONIC_MAX];
+    Disassembler::formatOpcode(instr.opcode, mnemonic);
+
+    std::string a = "0x" + Hex(address, 3);
+    std::string next = "0x" + Hex(address + INSTRUCTION_WIDTH, 3);
+    std::string op = "0x" + Hex(instr.opcode, 4);
+    std::string vx = "s.V[0x" + Hex(instr.x, 1) + "]";
+    std::string vy = "s.V[0x" + Hex(instr.y, 1) + "]";
+    std::string vf = "s.V[0xF]";
+    std::string kk = "0x" + Hex(instr.kk, 2);
+
+    out << "L_" << Hex(address, 3) << ": // " << Hex(instr.opcode, 4) << "  " << mnemonic << "\n"
+        << "    AOT_STEP(" << a << ");\n";
+
+    auto skipIf = [&](const std::string& condition) {
+        out << "    if (" << condition << ") { ";
+        EmitJump(out, block, address + 2 * INSTRUCTION_WIDTH);
+        out << " }\n";
+    };
+
+    switch (instr.operation) {
+        case OPERATION_NULL:
+            break;
+
+        case OPERATION_00EE:
+            out << "    s.sp--;\n"
+                << "    AOT_EXIT(s.stack[s.sp]);\n";
+            break;
+
+        case OPERATION_00FD:
+        case OPERATION_Fx0A:
+            // the handler moves pc back to stay on the instruction
+            out << "    s.pc = " << next << ";\n"
+                << "    Aot::Execute(chip8, " << op << ");\n"
+                << "    return budget;\n";
+            break;
+
+        case OPERATION_Fx33:
+        case OPERATION_Fx55:
+            // may have rewritten code, including this block's
+            out << "    Aot::Execute(chip8, " << op << ");\n"
+                << "    AOT_EXIT(" << next << ");\n";
+            break;
+
+        case OPERATION_1nnn:
+            out << "    ";
+            EmitJump(out, block, instr.nnn);
+            out << "\n";
+            break;
+
+        case OPERATION_2nnn:
+            out << "    s.stack[s.sp] = " << next << ";\n"
+                << "    s.sp++;\n"
+                << "    ";
+            EmitJump(out, block, instr.nnn);
+            out << "\n";
+            break;
+
+        case OPERATION_3xkk: skipIf(vx + " == " + kk); break;
+        case OPERATION_4xkk: skipIf(vx + " != " + kk); break;
+        case OPERATION_5xy0: skipIf(vx + " == " + vy); break;
+        case OPERATION_9xy0: skipIf(vx + " != " + vy); break;
+        case OPERATION_Ex9E: skipIf("s.keypad[" + vx + "]"); break;
+        case OPERATION_ExA1: skipIf("!s.keypad[" + vx + "]"); break;
+
+        case OPERATION_6xkk: out << "    " << vx << " = " << kk << ";\n"; break;
+        case OPERATION_7xkk: out << "    " << vx << " += " << kk << ";\n"; break;
+        case OPERATION_8xy0: out << "    " << vx << " = " << vy << ";\n"; break;
+        case OPERATION_8xy1: out << "    " << vx << " |= " << vy << ";\n"; break;
+        case OPERATION_8xy2: out << "    " << vx << " &= " << vy << ";\n"; break;
+        case OPERATION_8xy3: out << "    " << vx << " ^= " << vy << ";\n"; break;
+
+        case OPERATION_8xy4:
+            out << "    {\n"
+                << "        uint16_t sum = " << vx << " + " << vy << ";\n"
+                << "        " << vf << " = sum > 255u ? 1 : 0;\n"
+                << "        " << vx << " = sum & 0xFFu;\n"
+                << "    }\n";
+            break;
+
+        case OPERATION_8xy5:
+            out << "    " << vf << " = " << vx << " > " << vy << " ? 1 : 0;\n"
+                << "    " << vx << " -= " << vy << ";\n";
+            break;
+
+        case OPERATION_8xy6:
+            out << "    " << vf << " = " << vx << " & 0x1u;\n"
+                << "    " << vx << " >>= 1;\n";
+            break;
+
+        case OPERATION_8xy7:
+            out << "    " << vf << " = " << vy << " > " << vx << " ? 1 : 0;\n"
+                << "    " << vx << " = " << vy << " - " << vx << ";\n";
+            break;
+
+        case OPERATION_8xyE:
+            out << "    " << vf << " = (" << vx << " & 0x80u) >> 7u;\n"
+                << "    " << vx << " <<= 1;\n";
+            break;
+
+        case OPERATION_Annn:
+            out << "    s.I = 0x" << Hex(instr.nnn, 3) << ";\n";
+            break;
+
+        case OPERATION_Bnnn:
+            out << "    AOT_EXIT(s.V[0x0] + 0x" << Hex(instr.nnn, 3) << ");\n";
+            break;
+
+        case OPERATION_Fx07: out << "    " << vx << " = s.delayTimer;\n"; break;
+        case OPERATION_Fx15: out << "    s.delayTimer = " << vx << ";\n"; break;
+        case OPERATION_Fx18: out << "    s.soundTimer = " << vx << ";\n"; break;
+        case OPERATION_Fx1E: out << "    s.I += " << vx << ";\n"; break;
+
+        case OPERATION_Fx29:
+            out << "    s.I = FONTSET_START_ADDRESS + (" << vx << " * FONT_SIZE);\n";
+            break;
+
+        case OPERATION_Fx30:
+            out << "    s.I = BIG_FONTSET_START_ADDRESS + ((" << vx << " & 0x0Fu) * BIG_FONT_SIZE);\n";
+            break;
+
+        case OPERATION_Fx65:
+            for (unsigned int i = 0; i <= instr.x; i++) {
+                out << "    s.V[0x" << Hex(i, 1) << "] = s.memory[s.I + " << i << "];\n";
+            }
+            break;
+
+        case OPERATION_Fx75:
+            for (unsigned int i = 0; i <= instr.x && i < RPL_FLAGS; i++) {
+                out << "    s.rplFlags[" << i << "] = s.V[0x" << Hex(i, 1) << "];\n";
+            }
+            break;
+
+        case OPERATION_Fx85:
+            for (unsigned int i = 0; i <= instr.x && i < RPL_FLAGS; i++) {
+                out << "    s.V[0x" << Hex(i, 1) << "] = s.rplFlags[" << i << "];\n";
+            }
+            break;
+
+        default: // display, scrolling and RND
+            out << "    Aot::Execute(chip8, " << op << ");\n";
+            break;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <ROM> <output.cpp>\n";
+        return -1;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Invalid ROM file: " << argv[1] << std::endl;
+        return -1;
+    }
+
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (rom.empty() || rom.size() > MEMORY_SIZE - START_ADDRESS) {
+        std::cerr << "ERROR: ROM file empty or too large: " << argv[1] << std::endl;
+        return -1;
+    }
+
+    AotTranslator translator(rom);
+
+    std::ostringstream source;
+    translator.Write(source, argv[1]);
+
+    std::ofstream out(argv[2]);
+    if (!out.is_open() || !(out << source.str())) {
+        std::cerr << "ERROR: Unable to write " << argv[2] << std::endl;
+        return -1;
+    }
+
+    std::cerr << argv[1] << ": " << translator.GetBlockCount() << " blocks, "
+              << translator.GetInstructionCount() << " instructions" << std::endl;
+    return 0;
+}
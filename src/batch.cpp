@@ -0,0 +1,306 @@
+#include "chip8.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Headless batch runner.
+ *
+ * Manifest: one run per line, "#" starts a comment.
+ *     <ROM> <frames> [input script] [seed=<n>]
+ * Runs without a seed use the one given by --seed, so every run is
+ * repeatable.
+ *
+ * Input script: one key transition per line.
+ *     <frame> <key 0-F> <down|up>
+ */
+
+struct InputEvent {
+    uint32_t frame;
+    uint8_t key;
+    bool pressed;
+};
+
+struct BatchJob {
+    std::string rom;
+    uint32_t frames;
+    uint64_t seed;
+    std::vector<InputEvent> inputs;
+};
+
+struct BatchResult {
+    bool ok;
+    Engine engine; // the one that ran, the interpreter if the requested one isn't available
+    uint64_t instructions;
+    double wallMs;
+    uint64_t framebufferHash;
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t pc;
+    uint8_t sp;
+};
+
+/**
+ * Load an input script. Events are sorted by frame.
+ */
+static bool LoadInputScript(const std::string& filename, std::vector<InputEvent>& events) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Invalid input script: " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        uint32_t frame;
+        std::string key;
+        std::string state;
+
+        if (!(fields >> frame)) {
+            continue; // blank line
+        }
+
+        char* end = nullptr;
+        unsigned long value = 0;
+        if (fields >> key >> state) {
+            value = strtoul(key.c_str(), &end, 16);
+        }
+
+        if (end == nullptr || end == key.c_str() || *end != '\0' || value > 0xF
+            || (state != "down" && state != "up")) {
+            std::cerr << "ERROR: Bad input event in " << filename << ": " << line << std::endl;
+            return false;
+        }
+
+        events.push_back({frame, static_cast<uint8_t>(value), state == "down"});
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const InputEvent& a, const InputEvent& b) {
+        return a.frame < b.frame;
+    });
+
+    return true;
+}
+
+/**
+ * Load the run manifest.
+ */
+static bool LoadManifest(const char* filename, uint64_t seed, std::vector<BatchJob>& jobs) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Invalid manifest: " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream fields(line);
+        BatchJob job;
+        std::string field;
+
+        job.seed = seed;
+
+        if (!(fields >> job.rom)) {
+            continue; // blank line
+        }
+
+        if (!(fields >> job.frames)) {
+            std::cerr << "ERROR: Missing frame count in manifest: " << line << std::endl;
+            return false;
+        }
+
+        while (fields >> field) {
+            if (field.rfind("seed=", 0) == 0) {
+                job.seed = std::stoull(field.substr(5));
+            } else if (!LoadInputScript(field, job.inputs)) {
+                return false;
+            }
+        }
+
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+/**
+ * FNV-1a hash of the display.
+ */
+static uint64_t HashFramebuffer(const Chip8& chip8) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(chip8.video);
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < sizeof(chip8.video); i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/**
+ * Run one manifest entry on a fresh instance.
+ */
+static void RunJob(const BatchJob& job, unsigned int instructionsPerFrame, Engine engine, BatchResult& result) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<Chip8> chip8(new Chip8());
+    result.ok = chip8->LoadROM(job.rom.c_str());
+    result.instructions = 0;
+    result.engine = ENGINE_INTERPRETER;
+
+    if (result.ok) {
+        if (chip8->SetEngine(engine)) {
+            result.engine = engine;
+        } else {
+            // one write, so warnings from parallel jobs don't interleave
+            std::cerr << std::string(engine == ENGINE_AOT ? "WARNING: No chip8-aot translation of "
+                                                          : "WARNING: JIT not available on this host for ")
+                             + job.rom + ", using the interpreter\n";
+        }
+        chip8->SetSeed(job.seed);
+
+        size_t nextInput = 0;
+
+        for (uint32_t frame = 0; frame < job.frames; frame++) {
+            // apply this frame's key transitions
+            while (nextInput < job.inputs.size() && job.inputs[nextInput].frame <= frame) {
+                const InputEvent& event = job.inputs[nextInput++];
+                chip8->keypad[event.key] = event.pressed ? 1 : 0;
+            }
+
+            result.instructions += chip8->RunFrame(instructionsPerFrame);
+
+            /* waiting for a key with the timers run down, every frame until the
+                script's next event would just spin on Fx0A, so skip to it */
+            if (chip8->IsWaitingForKey() && chip8->GetDelayTimer() == 0 && chip8->GetSoundTimer() == 0) {
+                uint32_t resume = nextInput < job.inputs.size() ? std::min(job.inputs[nextInput].frame, job.frames) : job.frames;
+                if (resume > frame + 1) {
+                    result.instructions += static_cast<uint64_t>(resume - frame - 1) * instructionsPerFrame;
+                    frame = resume - 1;
+                }
+            }
+        }
+    }
+
+    result.framebufferHash = HashFramebuffer(*chip8);
+    memcpy(result.V, chip8->GetRegisters(), sizeof(result.V));
+    result.I = chip8->GetIndex();
+    result.pc = chip8->GetPC();
+    result.sp = chip8->GetSP();
+
+    result.wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <manifest> [options]\n"
+                  << "Options:\n"
+                  << "  --threads=<n>   worker threads (default: one per core)\n"
+                  << "  --ipf=<n>       instructions per frame (default: " << DEFAULT_INSTRUCTIONS_PER_FRAME << ")\n"
+                  << "  --jit           run on the x86-64 recompiler\n"
+                  << "  --aot           run ROMs translated by chip8-aot, where linked in\n"
+                  << "  --seed=<n>      RNG seed for runs the manifest gives none (default: 0)\n"
+                  << "  --output=<file> write results there instead of stdout\n";
+        return -1;
+    }
+
+    unsigned int threads = 0;
+    unsigned int instructionsPerFrame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+    Engine engine = ENGINE_INTERPRETER;
+    uint64_t seed = 0;
+    std::string output;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--threads=", 0) == 0) {
+            threads = std::stoi(arg.substr(10));
+        } else if (arg.rfind("--ipf=", 0) == 0) {
+            instructionsPerFrame = std::stoi(arg.substr(6));
+        } else if (arg == "--jit") {
+            engine = ENGINE_JIT;
+        } else if (arg == "--aot") {
+            engine = ENGINE_AOT;
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            seed = std::stoull(arg.substr(7));
+        } else if (arg.rfind("--output=", 0) == 0) {
+            output = arg.substr(9);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+
+    std::vector<BatchJob> jobs;
+    if (!LoadManifest(argv[1], seed, jobs)) {
+        return -1;
+    }
+
+    std::vector<BatchResult> results(jobs.size());
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        std::cerr << "Running " << jobs.size() << " jobs on " << pool.Size() << " threads" << std::endl;
+
+        for (size_t i = 0; i < jobs.size(); i++) {
+            pool.Submit([&, i] { RunJob(jobs[i], instructionsPerFrame, engine, results[i]); });
+        }
+
+        pool.Wait();
+    }
+    double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    FILE* out = output.empty() ? stdout : fopen(output.c_str(), "w");
+    if (out == nullptr) {
+        std::cerr << "ERROR: Unable to open output file: " << output << std::endl;
+        return -1;
+    }
+
+    // one CSV row per manifest entry, in manifest order
+    fprintf(out, "index,rom,status,engine,frames,seed,instructions,wall_ms,fb_hash,pc,i,sp");
+    for (int r = 0; r < 16; r++) {
+        fprintf(out, ",v%x", r);
+    }
+    fprintf(out, "\n");
+
+    uint64_t totalInstructions = 0;
+    int failed = 0;
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const BatchResult& r = results[i];
+        totalInstructions += r.instructions;
+        failed += r.ok ? 0 : 1;
+
+        fprintf(out, "%zu,%s,%s,%s,%u,%llu,%llu,%.3f,%016llx,%03x,%03x,%d", i, jobs[i].rom.c_str(), r.ok ? "ok" : "error",
+                ENGINE_NAMES[r.engine], jobs[i].frames, (unsigned long long) jobs[i].seed, (unsigned long long) r.instructions,
+                r.wallMs, (unsigned long long) r.framebufferHash, r.pc, r.I, r.sp);
+        for (int reg = 0; reg < 16; reg++) {
+            fprintf(out, ",%02x", r.V[reg]);
+        }
+        fprintf(out, "\n");
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    std::cerr << "Done: " << totalInstructions << " instructions in " << wallMs << " ms ("
+              << (wallMs > 0 ? totalInstructions / wallMs / 1000.0 : 0) << " MIPS)";
+    if (failed > 0) {
+        std::cerr << ", " << failed << " failed";
+    }
+    std::cerr << std::endl;
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,634 @@
+#include "chip8.h"
+#include "lanes.h"
+#include "rewind.h"
+#include "../disassemble/disassembler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/*
+ * Core microbenchmarks.
+ *
+ *     emulator-bench [options] [ROM...]
+ *
+ * Every benchmark runs a fixed amount of work on a fixed seed, repeated
+ * BENCH_REPEATS times, and the median is reported. Program benchmarks run
+ * on each available engine after one warmup pass, so the JIT is measured
+ * with its blocks already compiled. Lane benchmarks run LANE_COUNT
+ * copies of a program on separate seeds, as scalar Chip8 objects and as
+ * one LaneGroup, and report the instructions of all copies together.
+ */
+
+const unsigned int BENCH_REPEATS = 5;
+const uint32_t BENCH_INSTRUCTIONS = 2000000; // per program benchmark pass
+const unsigned int BENCH_STATE_ITERATIONS = 200000;
+const unsigned int BENCH_REWIND_SECONDS = 60;
+const unsigned int BENCH_DISASSEMBLY_ROMS = 2000; // full size ROM images per pass
+
+const uint16_t BENCH_DATA_ADDRESS = 0xE00; // sprites and scratch memory, after the generated code
+const uint16_t BENCH_SUBROUTINE_ADDRESS = 0xF00;
+const unsigned int BENCH_LOOP_SIZE = 256; // instructions in the body of a generated loop
+
+struct BenchResult {
+    std::string name;
+    std::string engine;
+    uint64_t ops; // instructions, or iterations for non-program benchmarks
+    double ns; // median time for all ops
+};
+
+static std::vector<BenchResult> results;
+static std::string filter;
+static bool jsonOnly = false;
+static bool fusion = true;
+
+static double NowNs() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool Selected(const std::string& name) {
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+static void Report(const std::string& name, const std::string& engine, uint64_t ops, double ns) {
+    results.push_back({name, engine, ops, ns});
+
+    if (!jsonOnly) {
+        printf("%-24s %-12s %10.2f ns/op %12.2f Mops/s\n", name.c_str(), engine.c_str(), ns / ops, ops / ns * 1000.0);
+    }
+}
+
+static double Median(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+/**
+ * Program image built from instructions and data.
+ */
+struct Program {
+    std::vector<uint8_t> image;
+
+    void Put(uint16_t address, uint16_t opcode) {
+        size_t offset = address - START_ADDRESS;
+        if (image.size() < offset + 2) {
+            image.resize(offset + 2);
+        }
+        image[offset] = opcode >> 8u;
+        image[offset + 1] = opcode & 0xFFu;
+    }
+
+    void PutData(uint16_t address, const std::vector<uint8_t>& bytes) {
+        size_t offset = address - START_ADDRESS;
+        if (image.size() < offset + bytes.size()) {
+            image.resize(offset + bytes.size());
+        }
+        memcpy(&image[offset], bytes.data(), bytes.size());
+    }
+};
+
+/**
+ * Setup instructions, then a body repeated to fill BENCH_LOOP_SIZE
+ * instructions, then a jump back to the start of the body.
+ * body(address, k) returns the k-th instruction of the body.
+ */
+template <typename Body>
+static Program BuildLoop(const std::vector<uint16_t>& setup, unsigned int bodySize, Body body) {
+    Program program;
+    uint16_t address = START_ADDRESS;
+
+    for (uint16_t opcode : setup) {
+        program.Put(address, opcode);
+        address += 2;
+    }
+
+    uint16_t loop = address;
+    for (unsigned int i = 0; i + bodySize <= BENCH_LOOP_SIZE; i += bodySize) {
+        for (unsigned int k = 0; k < bodySize; k++) {
+            program.Put(address, body(address, k));
+            address += 2;
+        }
+    }
+
+    program.Put(address, 0x1000 | loop); // JP loop
+    return program;
+}
+
+static Program Repeat(const std::vector<uint16_t>& setup, uint16_t opcode) {
+    return BuildLoop(setup, 1, [opcode](uint16_t, unsigned int) { return opcode; });
+}
+
+static uint16_t LoadI(uint16_t address) {
+    return 0xA000 | address;
+}
+
+/**
+ * Run a program for BENCH_INSTRUCTIONS on each engine.
+ */
+static void BenchProgram(const std::string& name, const Program& program) {
+    if (!Selected(name)) {
+        return;
+    }
+
+    for (Engine engine : {ENGINE_INTERPRETER, ENGINE_JIT, ENGINE_AOT}) {
+        std::unique_ptr<Chip8> chip8(new Chip8());
+        chip8->SetSeed(1);
+        chip8->SetFusion(fusion);
+        // translations are only linked in for ROMs, see AOT_ROMS
+        if (!chip8->LoadProgram(program.image.data(), program.image.size()) || !chip8->SetEngine(engine)) {
+            continue;
+        }
+
+        chip8->Run(BENCH_INSTRUCTIONS); // warmup
+
+        std::vector<double> samples;
+        uint64_t executed = 0;
+
+        for (unsigned int r = 0; r < BENCH_REPEATS; r++) {
+            double start = NowNs();
+            executed = chip8->Run(BENCH_INSTRUCTIONS);
+            samples.push_back(NowNs() - start);
+        }
+
+        // the interpreter is labelled with the dispatch it was built with
+        Report(name, engine == ENGINE_JIT ? "jit" : engine == ENGINE_AOT ? "aot" : DISPATCH_NAMES[CHIP8_DISPATCH],
+               executed, Median(samples));
+
+        // how often each superinstruction fired over all runs
+        if (engine == ENGINE_INTERPRETER && name.rfind("rom/", 0) == 0 && !jsonOnly) {
+            for (unsigned int op = FIRST_FUSED_OPERATION; op < OPERATION_COUNT; op++) {
+                uint64_t count = chip8->GetFusionCount(static_cast<Operation>(op));
+                if (count > 0) {
+                    printf("    fused %-16s %10llu times, %6.1f per 1000 instructions\n", OPERATION_NAMES[op],
+                           static_cast<unsigned long long>(count),
+                           count * 1000.0 / ((BENCH_REPEATS + 1) * BENCH_INSTRUCTIONS));
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Run LANE_COUNT copies of a program for BENCH_INSTRUCTIONS in total,
+ * on scalar Chip8 objects and on a LaneGroup.
+ */
+static void BenchLanes(const std::string& name, const Program& program) {
+    if (!Selected(name)) {
+        return;
+    }
+
+    const uint32_t perLane = BENCH_INSTRUCTIONS / LANE_COUNT;
+
+    std::vector<std::unique_ptr<Chip8>> scalar;
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        scalar.emplace_back(new Chip8());
+        scalar[lane]->SetSeed(lane + 1);
+        scalar[lane]->SetFusion(fusion);
+        if (!scalar[lane]->LoadProgram(program.image.data(), program.image.size())) {
+            return;
+        }
+        scalar[lane]->Run(perLane); // warmup
+    }
+
+    std::vector<double> samples;
+    uint64_t executed = 0;
+
+    for (unsigned int r = 0; r < BENCH_REPEATS; r++) {
+        double start = NowNs();
+        executed = 0;
+        for (std::unique_ptr<Chip8>& chip8 : scalar) {
+            executed += chip8->Run(perLane);
+        }
+        samples.push_back(NowNs() - start);
+    }
+
+    Report(name, "scalar x" + std::to_string(LANE_COUNT), executed, Median(samples));
+
+    std::unique_ptr<LaneGroup> group(new LaneGroup());
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        group->SetSeed(lane, lane + 1);
+    }
+    group->LoadProgram(program.image.data(), program.image.size());
+    group->Run(perLane); // warmup
+
+    samples.clear();
+    for (unsigned int r = 0; r < BENCH_REPEATS; r++) {
+        double start = NowNs();
+        executed = group->Run(perLane);
+        samples.push_back(NowNs() - start);
+    }
+
+    Report(name, std::string(LaneGroup::Available() ? "avx2" : "lanes") + " x" + std::to_string(LANE_COUNT), executed,
+           Median(samples));
+}
+
+/**
+ * Raw dispatch and one loop per opcode family.
+ */
+static void BenchOpcodes() {
+    const std::vector<uint16_t> none;
+    const uint16_t data = BENCH_DATA_ADDRESS;
+
+    // the cheapest handler, so this is mostly fetch and dispatch
+    BenchProgram("dispatch", Repeat(none, 0x6000));
+
+    Program call = Repeat(none, 0x2000 | BENCH_SUBROUTINE_ADDRESS);
+    call.Put(BENCH_SUBROUTINE_ADDRESS, 0x00EE);
+
+    BenchProgram("op/00E0 cls", Repeat(none, 0x00E0));
+    BenchProgram("op/2nnn+00EE call", call);
+    BenchProgram("op/1nnn jp", BuildLoop(none, 1, [](uint16_t at, unsigned int) { return 0x1000 | (at + 2); }));
+    BenchProgram("op/3xkk se", Repeat({0x6000}, 0x3001));
+    BenchProgram("op/4xkk sne", Repeat({0x6000}, 0x4000));
+    BenchProgram("op/5xy0 se", Repeat({0x6000, 0x6101}, 0x5010));
+    BenchProgram("op/6xkk ld", Repeat(none, 0x6312));
+    BenchProgram("op/7xkk add", Repeat(none, 0x7301));
+    BenchProgram("op/8xy0 ld", Repeat(none, 0x8120));
+    BenchProgram("op/8xy1 or", Repeat(none, 0x8121));
+    BenchProgram("op/8xy2 and", Repeat(none, 0x8122));
+    BenchProgram("op/8xy3 xor", Repeat(none, 0x8123));
+    BenchProgram("op/8xy4 add", Repeat({0x6203}, 0x8124));
+    BenchProgram("op/8xy5 sub", Repeat({0x6203}, 0x8125));
+    BenchProgram("op/8xy6 shr", Repeat(none, 0x8126));
+    BenchProgram("op/8xy7 subn", Repeat({0x6203}, 0x8127));
+    BenchProgram("op/8xyE shl", Repeat(none, 0x812E));
+    BenchProgram("op/9xy0 sne", Repeat({0x6000, 0x6100}, 0x9010));
+    BenchProgram("op/Annn ld", Repeat(none, LoadI(data)));
+    BenchProgram("op/Bnnn jp", BuildLoop({0x6000}, 1, [](uint16_t at, unsigned int) { return 0xB000 | (at + 2); }));
+    BenchProgram("op/Cxkk rnd", Repeat(none, 0xC3FF));
+    BenchProgram("op/Ex9E skp", Repeat(none, 0xE39E));
+    BenchProgram("op/ExA1 sknp", Repeat(none, 0xE3A1));
+    BenchProgram("op/Fx07 ld", Repeat(none, 0xF307));
+    BenchProgram("op/Fx15 ld", Repeat(none, 0xF315));
+    BenchProgram("op/Fx18 ld", Repeat(none, 0xF318));
+    BenchProgram("op/Fx1E add", Repeat({LoadI(0)}, 0xF31E));
+    BenchProgram("op/Fx29 ld", Repeat(none, 0xF329));
+    BenchProgram("op/Fx30 ld", Repeat(none, 0xF330));
+    BenchProgram("op/Fx33 bcd", Repeat({LoadI(data), 0x63FF}, 0xF333));
+    BenchProgram("op/Fx55 store", Repeat({LoadI(data)}, 0xFF55));
+    BenchProgram("op/Fx65 load", Repeat({LoadI(data)}, 0xFF65));
+    BenchProgram("op/Fx75 save", Repeat(none, 0xF775));
+    BenchProgram("op/Fx85 restore", Repeat(none, 0xF785));
+    BenchProgram("op/00Cn scd", Repeat({0x00FF}, 0x00C4));
+    BenchProgram("op/00FB scr", Repeat({0x00FF}, 0x00FB));
+    BenchProgram("op/00FC scl", Repeat({0x00FF}, 0x00FC));
+}
+
+/**
+ * Sprite drawing across heights and collision rates.
+ * Collisions are controlled through the sprite data:
+ *   0%    the sprite rows are blank
+ *   50%   the same sprite is toggled on and off
+ *   100%  0b11 is drawn over a primed 0b10, which then flips between
+ *         0b01 and 0b10 and always overlaps a lit pixel
+ */
+static void BenchDraw() {
+    const uint16_t data = BENCH_DATA_ADDRESS;
+    const uint16_t primer = data + 0x20;
+
+    struct Variant {
+        const char* name;
+        uint8_t row;
+        uint8_t primerRow;
+    };
+
+    const Variant variants[] = {
+        {"0%", 0x00, 0x00},
+        {"50%", 0xF0, 0x00},
+        {"100%", 0x03, 0x02},
+    };
+
+    for (uint16_t height : {1, 5, 15}) {
+        for (const Variant& variant : variants) {
+            // V0 = 10, V1 = 4, draw the primer once, then loop on the sprite
+            std::vector<uint16_t> setup = {0x600A, 0x6104, LoadI(primer), static_cast<uint16_t>(0xD010 | height), LoadI(data)};
+
+            Program program = Repeat(setup, 0xD010 | height);
+            program.PutData(data, std::vector<uint8_t>(16, variant.row));
+            program.PutData(primer, std::vector<uint8_t>(16, variant.primerRow));
+
+            BenchProgram("draw/Dxyn h" + std::to_string(height) + " " + variant.name, program);
+        }
+    }
+
+    // x = 60 straddles the two words of a high resolution row
+    Program straddle = Repeat({0x00FF, 0x603C, 0x6104, LoadI(data)}, 0xD01F);
+    straddle.PutData(data, std::vector<uint8_t>(16, 0xFF));
+    BenchProgram("draw/Dxyn h15 hires", straddle);
+
+    Program big = Repeat({0x00FF, 0x603C, 0x6104, LoadI(data)}, 0xD010);
+    big.PutData(data, std::vector<uint8_t>(32, 0xFF));
+    BenchProgram("draw/Dxy0 16x16", big);
+}
+
+/**
+ * Whole programs mixing control flow, ALU work, memory and drawing.
+ */
+static void BenchWorkloads() {
+    const uint16_t data = BENCH_DATA_ADDRESS;
+
+    // a typical game frame: move and draw a sprite, keep score, clear now and then
+    const uint16_t gameCode[] = {
+        0x6000, 0x6100,     // 200: V0 = 0, V1 = 0
+        LoadI(data),        // 204: I = sprite
+        0xD015,             // 206: DRW V0, V1, 5
+        0x7003, 0x7101,     // 208: move
+        0xC2FF,             // 20C: RND V2
+        LoadI(data + 0x10), // 20E: I = score
+        0xF233,             // 210: BCD V2
+        0xF265,             // 212: load V0-V2
+        LoadI(data),        // 214: I = sprite
+        0x3203, 0x1206,     // 216: loop unless V2 == 3
+        0x00E0, 0x1206,     // 21A: clear and loop
+    };
+
+    Program game;
+    for (unsigned int i = 0; i < sizeof(gameCode) / sizeof(gameCode[0]); i++) {
+        game.Put(START_ADDRESS + i * 2, gameCode[i]);
+    }
+    game.PutData(data, {0xF0, 0x90, 0xF0, 0x90, 0xF0});
+    BenchProgram("rom/game loop", game);
+    BenchLanes("lanes/game loop", game);
+
+    // register arithmetic with a counted inner loop and a subroutine
+    const uint16_t aluCode[] = {
+        0x6A00,         // 200: VA = 0
+        0x6B10,         // 202: VB = 16
+        0x8014, 0x8125, // 204: V0 += V1, V1 -= V2
+        0x8236, 0x830E, // 208: shifts
+        0x2220,         // 20C: CALL 220
+        0x7BFF,         // 20E: VB--
+        0x3B00, 0x1204, // 210: loop until VB == 0
+        0x7A01,         // 214: VA++
+        0x1202,         // 216: outer loop
+        0x0000, 0x0000, 0x0000, 0x0000,
+        0x8453, 0x8541, // 220: XOR, OR
+        0x8652, 0x00EE, // 224: AND, RET
+    };
+
+    Program alu;
+    for (unsigned int i = 0; i < sizeof(aluCode) / sizeof(aluCode[0]); i++) {
+        alu.Put(START_ADDRESS + i * 2, aluCode[i]);
+    }
+    BenchProgram("rom/alu loop", alu);
+    BenchLanes("lanes/alu loop", alu);
+
+    // the usual frame wait, the timer never ticks inside a run so it spins throughout
+    const uint16_t waitCode[] = {
+        0x60FF,         // 200: V0 = 255
+        0xF015,         // 202: DT = V0
+        0xF107,         // 204: V1 = DT
+        0x3100, 0x1204, // 206: loop until V1 == 0
+        0x1202,         // 20A: again
+    };
+
+    Program wait;
+    for (unsigned int i = 0; i < sizeof(waitCode) / sizeof(waitCode[0]); i++) {
+        wait.Put(START_ADDRESS + i * 2, waitCode[i]);
+    }
+    BenchProgram("rom/timer wait", wait);
+    BenchLanes("lanes/timer wait", wait);
+}
+
+/**
+ * Run a ROM file like the workloads above.
+ */
+static void BenchROM(const char* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Invalid ROM file: " << filename << std::endl;
+        return;
+    }
+
+    Program program;
+    program.image.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    BenchProgram(std::string("rom/") + filename, program);
+    BenchLanes(std::string("lanes/") + filename, program);
+}
+
+/**
+ * Save state snapshot and restore cost.
+ */
+static void BenchSaveState() {
+    if (!Selected("state")) {
+        return;
+    }
+
+    Chip8 chip8;
+    chip8.SetSeed(1);
+
+    Program program = Repeat({LoadI(BENCH_DATA_ADDRESS)}, 0xC3FF);
+    program.Put(START_ADDRESS + 4, 0xF333);
+    chip8.LoadProgram(program.image.data(), program.image.size());
+
+    std::unique_ptr<Chip8State> state(new Chip8State());
+    std::unique_ptr<Chip8State> other(new Chip8State());
+
+    chip8.SaveState(*state);
+    chip8.Run(100);
+    chip8.SaveState(*other);
+
+    std::vector<double> save;
+    std::vector<double> restore;
+
+    for (unsigned int r = 0; r < BENCH_REPEATS; r++) {
+        double start = NowNs();
+        for (unsigned int i = 0; i < BENCH_STATE_ITERATIONS; i++) {
+            chip8.SaveState(i & 1 ? *state : *other);
+        }
+        save.push_back(NowNs() - start);
+
+        // the two snapshots differ in registers and a few bytes of memory
+        start = NowNs();
+        for (unsigned int i = 0; i < BENCH_STATE_ITERATIONS; i++) {
+            chip8.LoadState(i & 1 ? *state : *other);
+        }
+        restore.push_back(NowNs() - start);
+    }
+
+    Report("state/snapshot", "-", BENCH_STATE_ITERATIONS, Median(save));
+    Report("state/restore", "-", BENCH_STATE_ITERATIONS, Median(restore));
+
+    // a file of our own, so concurrent runs don't share one
+    const char* tmpdir = getenv("TMPDIR");
+    std::string path = std::string(tmpdir != nullptr && tmpdir[0] != '\0' ? tmpdir : "/tmp") + "/chip8-bench-XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        std::cerr << "WARNING: Unable to create a temporary file, skipping state/file round trip" << std::endl;
+        return;
+    }
+    close(fd);
+
+    const unsigned int fileIterations = 1000;
+
+    double start = NowNs();
+    for (unsigned int i = 0; i < fileIterations; i++) {
+        chip8.SaveState(path.c_str());
+        chip8.LoadState(path.c_str());
+    }
+    Report("state/file round trip", "-", fileIterations, NowNs() - start);
+
+    unlink(path.c_str());
+}
+
+/**
+ * Rewind capture and step back cost for a minute of history.
+ */
+static void BenchRewind() {
+    if (!Selected("rewind")) {
+        return;
+    }
+
+    const unsigned int frames = BENCH_REWIND_SECONDS * FRAMES_PER_SECOND;
+
+    Chip8 chip8;
+    chip8.SetSeed(1);
+
+    // a sprite moving across the screen
+    Program program = BuildLoop({0x6000, 0x6100, LoadI(BENCH_DATA_ADDRESS)}, 3,
+                                [](uint16_t, unsigned int k) { return k == 0 ? 0xD015 : k == 1 ? 0x7003 : 0x7101; });
+    program.PutData(BENCH_DATA_ADDRESS, {0xF0, 0x90, 0xF0, 0x90, 0xF0});
+    chip8.LoadProgram(program.image.data(), program.image.size());
+
+    RewindBuffer history(frames);
+    std::unique_ptr<Chip8State> state(new Chip8State());
+
+    double capture = 0;
+    for (unsigned int frame = 0; frame < frames; frame++) {
+        chip8.RunFrame(DEFAULT_INSTRUCTIONS_PER_FRAME);
+
+        double start = NowNs();
+        chip8.SaveState(*state);
+        history.Push(*state);
+        capture += NowNs() - start;
+    }
+
+    size_t bytes = history.GetMemoryUsage();
+
+    double start = NowNs();
+    unsigned int popped = 0;
+    while (history.Pop(*state)) {
+        popped++;
+    }
+
+    Report("rewind/capture", "-", frames, capture);
+    Report("rewind/step back", "-", popped, NowNs() - start);
+
+    if (!jsonOnly) {
+        printf("%-24s %-12s %10zu KB for %u frames\n", "rewind/history", "-", bytes / 1024, frames);
+    }
+}
+
+/**
+ * Bulk disassembly throughput over full size ROM images.
+ */
+static void BenchDisassembler() {
+    if (!Selected("disasm")) {
+        return;
+    }
+
+    const size_t romSize = MEMORY_SIZE - START_ADDRESS;
+
+    std::vector<uint8_t> rom(romSize);
+    std::mt19937 random(1);
+    for (uint8_t& byte : rom) {
+        byte = random();
+    }
+
+    Disassembler disassembler;
+    std::vector<char> out;
+    disassembler.disassemble(rom.data(), rom.size(), out); // warmup, builds the line tables
+
+    std::vector<double> samples;
+    for (unsigned int r = 0; r < BENCH_REPEATS; r++) {
+        double start = NowNs();
+        for (unsigned int i = 0; i < BENCH_DISASSEMBLY_ROMS; i++) {
+            disassembler.disassemble(rom.data(), rom.size(), out);
+        }
+        samples.push_back(NowNs() - start);
+    }
+
+    double ns = Median(samples);
+    Report("disasm/format", "-", BENCH_DISASSEMBLY_ROMS * (romSize / 2), ns);
+
+    if (!jsonOnly) {
+        printf("%-24s %-12s %10.1f MB/s\n", "disasm/throughput", "-", BENCH_DISASSEMBLY_ROMS * romSize / ns * 1000.0);
+    }
+}
+
+/**
+ * Write the results as JSON.
+ */
+static void WriteJSON(FILE* out) {
+    fprintf(out, "{\n  \"benchmarks\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"engine\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, \"ops_per_sec\": %.1f}%s\n",
+                r.name.c_str(), r.engine.c_str(), (unsigned long long) r.ops, r.ns / r.ops, r.ops / r.ns * 1e9,
+                i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char* argv[]) {
+    std::string json;
+    std::vector<const char*> roms;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--json") {
+            jsonOnly = true;
+        } else if (arg.rfind("--json=", 0) == 0) {
+            json = arg.substr(7);
+        } else if (arg.rfind("--filter=", 0) == 0) {
+            filter = arg.substr(9);
+        } else if (arg == "--no-fusion") {
+            fusion = false;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Usage: " << argv[0] << " [options] [ROM...]\n"
+                      << "Options:\n"
+                      << "  --filter=<text>   only run benchmarks whose name contains text\n"
+                      << "  --json            print JSON instead of the table\n"
+                      << "  --json=<file>     also write JSON to a file\n"
+                      << "  --no-fusion       interpret without superinstructions\n";
+            return arg == "--help" ? 0 : -1;
+        } else {
+            roms.push_back(argv[i]);
+        }
+    }
+
+    BenchOpcodes();
+    BenchDraw();
+    BenchWorkloads();
+    for (const char* rom : roms) {
+        BenchROM(rom);
+    }
+    BenchSaveState();
+    BenchRewind();
+    BenchDisassembler();
+
+    if (jsonOnly) {
+        WriteJSON(stdout);
+    }
+
+    if (!json.empty()) {
+        FILE* out = fopen(json.c_str(), "w");
+        if (out == nullptr) {
+            std::cerr << "ERROR: Unable to open output file: " << json << std::endl;
+            return -1;
+        }
+        WriteJSON(out);
+        fclose(out);
+    }
+
+    return 0;
+}
@@ -1,4 +1,6 @@
 #include "chip8.h"
+#include "aot.h"
+#include "jit.h"
 
 uint8_t fontset[FONTSET_SIZE] = {
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -22,14 +24,55 @@ uint8_t fontset[FONTSET_SIZE] = {
     Each is displayed in a 8x5 pixel image, which can 
     be represented by 5 bytes.*/
 
+uint8_t bigFontset[BIG_FONTSET_SIZE] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+/* SCHIP 8x10 digits, stored right after the small font. */
+
 
-Chip8::Chip8() : randGen(std::chrono::system_clock::now().time_since_epoch().count()) {
+Chip8::Chip8() : trace(nullptr), jit(nullptr), aot(nullptr) {
     // initialize pc
     pc = START_ADDRESS;
 
     // init sp
     sp = 0;
 
+    // clear registers, timers and stack
+    I = 0;
+    opcode = 0;
+    delayTimer = 0;
+    soundTimer = 0;
+    memset(V, 0, sizeof(V));
+    memset(stack, 0, sizeof(stack));
+    memset(rplFlags, 0, sizeof(rplFlags));
+
+    // start in CHIP-8 low resolution mode
+    highRes = false;
+    halted = false;
+    waitingForKey = false;
+    keyWait = KEY_WAIT_NONE;
+
+    // clear keypad and display
+    memset(keypad, 0, sizeof(keypad));
+    memset(video, 0, sizeof(video));
+    dirtyRows = ALL_ROWS;
+    frameGeneration = 0;
+
     // zero out memory
     memset(memory, 0, sizeof(uint8_t) * MEMORY_SIZE);
 
@@ -38,31 +81,57 @@ Chip8::Chip8() : randGen(std::chrono::system_clock::now().time_since_epoch().cou
         memory[FONTSET_START_ADDRESS + i] = fontset[i];
     }
 
+    for (unsigned int i = 0; i < BIG_FONTSET_SIZE; i++) {
+        memory[BIG_FONTSET_START_ADDRESS + i] = bigFontset[i];
+    }
+
     LoadOpcodeTables();
 
+    // nothing decoded yet
+    instr = nullptr;
+    idle = false;
+    fusion = true;
+    memset(fusions, 0, sizeof(fusions));
+    for (unsigned int i = 0; i < DECODE_CACHE_SIZE; i++) {
+        decodeCache[i].handler = nullptr;
+        decodeCache[i].length = 0;
+    }
+
     // initialize random number generator
-    randByte = std::uniform_int_distribution<uint8_t>(0, 255U);
+    SetSeed(std::chrono::system_clock::now().time_since_epoch().count());
 }
 
 Chip8::~Chip8() {
-
+    delete jit;
+    delete aot;
 }
 
 /** 
  * Simulate one cycle
  */
 void Chip8::Cycle() {
-    printf("PC: %03x\n", pc);
+    // fetch predecoded instruction
+    instr = &Fetch(pc);
+    opcode = instr->opcode;
+
+    // exactly one instruction, even where a superinstruction starts
+    if (instr->length > 1) {
+        Decode(opcode, decodeScratch);
+        instr = &decodeScratch;
+    }
 
-    // fetch instruction
-    opcode = (memory[pc] << 8u) | memory[pc + 1];
-    pc += 2;
+    TRACE_RECORD(trace, pc, opcode, I, sp);
 
-    printf("Opcode: 0x%04x\n", opcode);
+    pc += 2;
 
-    // decode and execute
-    ((*this).*(table[(opcode & 0xF000u) >> 12u]))();
+    // execute
+    ((*this).*(instr->handler))();
+}
 
+/**
+ * Decrement the 60 Hz timers.
+ */
+void Chip8::TickTimers() {
     // decrement delay timer
     if (delayTimer > 0) {
         delayTimer--;
@@ -74,11 +143,41 @@ void Chip8::Cycle() {
     }
 }
 
+/**
+ * Execute a number of instructions with the selected engine.
+ * Returns the number of instructions executed.
+ */
+uint32_t Chip8::Run(uint32_t instructions) {
+    // traces are recorded per instruction, so tracing always interprets
+    if (jit != nullptr && !IsTracing()) {
+        return jit->Run(instructions);
+    }
+
+    if (aot != nullptr && !IsTracing()) {
+        return aot->Run(instructions);
+    }
+
+    return Interpret<CHIP8_DISPATCH>(instructions);
+}
+
+/**
+ * Run one 60 Hz frame: a fixed number of instructions, then one timer tick.
+ * Returns the number of instructions executed.
+ */
+uint32_t Chip8::RunFrame(uint32_t instructionsPerFrame) {
+    uint32_t executed = Run(instructionsPerFrame);
+
+    TickTimers();
+
+    return executed;
+}
+
 /**
  * Load a ROM into memory.
  * The contents are loaded starting at 0x200 in memory.
+ * Returns false if the file can't be read or doesn't fit.
  */
-void Chip8::LoadROM(const char* filename) {
+bool Chip8::LoadROM(const char* filename) {
     // open file stream
     // ios::ate places cursor at endfile after opening
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
@@ -86,6 +185,12 @@ void Chip8::LoadROM(const char* filename) {
     if (file.is_open()) {
         // get size and allocate buffer
         std::streampos size = file.tellg(); 
+
+        if (size > MEMORY_SIZE - START_ADDRESS) {
+            std::cerr << "ERROR: ROM file too large: " << filename << std::endl;
+            return false;
+        }
+
         char* buffer = new char[size];
 
         // move cursor to beginning of file
@@ -102,98 +207,566 @@ void Chip8::LoadROM(const char* filename) {
 
         // free the buffer
         delete[] buffer;
+
+        // drop anything decoded from the previous contents
+        InvalidateCache(START_ADDRESS, DECODE_CACHE_SIZE);
     } else {
-        std::cerr << "ERROR: Invalid ROM file. Aborting" << std::endl;
+        std::cerr << "ERROR: Invalid ROM file: " << filename << std::endl;
         //this->MemoryDump();
-        exit(-1);
+        return false;
     } 
+
+    return true;
+}
+
+/**
+ * Load a program image from memory, starting at 0x200.
+ * Returns false if it doesn't fit.
+ */
+bool Chip8::LoadProgram(const uint8_t* data, size_t size) {
+    if (size > MEMORY_SIZE - START_ADDRESS) {
+        std::cerr << "ERROR: Program too large: " << size << " bytes" << std::endl;
+        return false;
+    }
+
+    memcpy(&memory[START_ADDRESS], data, size);
+
+    // drop anything decoded from the previous contents
+    InvalidateCache(START_ADDRESS, DECODE_CACHE_SIZE);
+
+    return true;
+}
+
+/**
+ * Attach an instruction trace (or nullptr to detach).
+ * The trace is not owned and must outlive the emulator.
+ */
+void Chip8::SetTrace(Trace* trace) {
+    this->trace = trace;
+}
+
+/**
+ * Select the execution engine.
+ * Returns false if the engine is not available on this host, or for
+ * ENGINE_AOT, if no translation of the loaded program was linked in.
+ */
+bool Chip8::SetEngine(Engine engine) {
+    delete jit;
+    jit = nullptr;
+    delete aot;
+    aot = nullptr;
+
+    if (engine == ENGINE_JIT) {
+        if (!Jit::Available()) {
+            return false;
+        }
+        jit = new Jit(*this);
+    }
+
+    // translations are matched against the program already loaded
+    if (engine == ENGINE_AOT) {
+        const AotProgram* program = Aot::Find(*this);
+        if (program == nullptr) {
+            return false;
+        }
+        aot = new Aot(*this, *program);
+    }
+
+    return true;
 }
 
 /**
  * Load main opcode table data
  */
 void Chip8::LoadOpcodeTables() {
-    // Set up function pointer table
-	table[0x0] = &Chip8::Table0;
-	table[0x1] = &Chip8::OP_1nnn;
-	table[0x2] = &Chip8::OP_2nnn;
-	table[0x3] = &Chip8::OP_3xkk;
-	table[0x4] = &Chip8::OP_4xkk;
-	table[0x5] = &Chip8::OP_5xy0;
-	table[0x6] = &Chip8::OP_6xkk;
-	table[0x7] = &Chip8::OP_7xkk;
-	table[0x8] = &Chip8::Table8;
-	table[0x9] = &Chip8::OP_9xy0;
-	table[0xA] = &Chip8::OP_Annn;
-	table[0xB] = &Chip8::OP_Bnnn;
-	table[0xC] = &Chip8::OP_Cxkk;
-	table[0xD] = &Chip8::OP_Dxyn;
-	table[0xE] = &Chip8::TableE;
-	table[0xF] = &Chip8::TableF;
+    // one handler per operation, for table dispatch
+#define CHIP8_OPERATION_HANDLER(name) handlers[OPERATION_##name] = &Chip8::OP_##name;
+    CHIP8_OPERATIONS(CHIP8_OPERATION_HANDLER)
+#undef CHIP8_OPERATION_HANDLER
+
+    // Set up operation table
+    // 0x0, 0x8, 0xE and 0xF are resolved through the secondary tables in Decode
+	table[0x0] = OPERATION_NULL;
+	table[0x1] = OPERATION_1nnn;
+	table[0x2] = OPERATION_2nnn;
+	table[0x3] = OPERATION_3xkk;
+	table[0x4] = OPERATION_4xkk;
+	table[0x5] = OPERATION_5xy0;
+	table[0x6] = OPERATION_6xkk;
+	table[0x7] = OPERATION_7xkk;
+	table[0x8] = OPERATION_NULL;
+	table[0x9] = OPERATION_9xy0;
+	table[0xA] = OPERATION_Annn;
+	table[0xB] = OPERATION_Bnnn;
+	table[0xC] = OPERATION_Cxkk;
+	table[0xD] = OPERATION_Dxyn;
+	table[0xE] = OPERATION_NULL;
+	table[0xF] = OPERATION_NULL;
 
 	for (size_t i = 0; i <= 0xE; i++) {
-		table0[i] = &Chip8::OP_NULL;
-		table8[i] = &Chip8::OP_NULL;
-		tableE[i] = &Chip8::OP_NULL;
+		table8[i] = OPERATION_NULL;
+		tableE[i] = OPERATION_NULL;
 	}
 
-	table0[0x0] = &Chip8::OP_00E0;
-	table0[0xE] = &Chip8::OP_00EE;
+	// table 0 is keyed by the low byte
+	for (size_t i = 0; i <= 0xFF; i++) {
+		table0[i] = OPERATION_NULL;
+	}
 
-	table8[0x0] = &Chip8::OP_8xy0;
-	table8[0x1] = &Chip8::OP_8xy1;
-	table8[0x2] = &Chip8::OP_8xy2;
-	table8[0x3] = &Chip8::OP_8xy3;
-	table8[0x4] = &Chip8::OP_8xy4;
-	table8[0x5] = &Chip8::OP_8xy5;
-	table8[0x6] = &Chip8::OP_8xy6;
-	table8[0x7] = &Chip8::OP_8xy7;
-	table8[0xE] = &Chip8::OP_8xyE;
+	table0[0xE0] = OPERATION_00E0;
+	table0[0xEE] = OPERATION_00EE;
+	for (size_t i = 0xC0; i <= 0xCF; i++) {
+		table0[i] = OPERATION_00Cn;
+	}
+	table0[0xFB] = OPERATION_00FB;
+	table0[0xFC] = OPERATION_00FC;
+	table0[0xFD] = OPERATION_00FD;
+	table0[0xFE] = OPERATION_00FE;
+	table0[0xFF] = OPERATION_00FF;
+
+	table8[0x0] = OPERATION_8xy0;
+	table8[0x1] = OPERATION_8xy1;
+	table8[0x2] = OPERATION_8xy2;
+	table8[0x3] = OPERATION_8xy3;
+	table8[0x4] = OPERATION_8xy4;
+	table8[0x5] = OPERATION_8xy5;
+	table8[0x6] = OPERATION_8xy6;
+	table8[0x7] = OPERATION_8xy7;
+	table8[0xE] = OPERATION_8xyE;
+
+	tableE[0x1] = OPERATION_ExA1;
+	tableE[0xE] = OPERATION_Ex9E;
+
+	for (size_t i = 0; i <= 0x85; i++) {
+		tableF[i] = OPERATION_NULL;
+	}
 
-	tableE[0x1] = &Chip8::OP_ExA1;
-	tableE[0xE] = &Chip8::OP_Ex9E;
+	tableF[0x07] = OPERATION_Fx07;
+	tableF[0x0A] = OPERATION_Fx0A;
+	tableF[0x15] = OPERATION_Fx15;
+	tableF[0x18] = OPERATION_Fx18;
+	tableF[0x1E] = OPERATION_Fx1E;
+	tableF[0x29] = OPERATION_Fx29;
+	tableF[0x30] = OPERATION_Fx30;
+	tableF[0x33] = OPERATION_Fx33;
+	tableF[0x55] = OPERATION_Fx55;
+	tableF[0x65] = OPERATION_Fx65;
+	tableF[0x75] = OPERATION_Fx75;
+	tableF[0x85] = OPERATION_Fx85;
+}
 
-	for (size_t i = 0; i <= 0x65; i++) {
-		tableF[i] = &Chip8::OP_NULL;
-	}
+/**
+ * Decode an opcode into its handler and operands.
+ */
+void Chip8::Decode(uint16_t opcode, Instruction& out) const {
+    out.opcode = opcode;
+    out.nnn = opcode & 0x0FFFu;
+    out.x = (opcode & 0x0F00u) >> 8u;
+    out.y = (opcode & 0x00F0u) >> 4u;
+    out.n = opcode & 0x000Fu;
+    out.kk = opcode & 0x00FFu;
+
+    switch ((opcode & 0xF000u) >> 12u) {
+        case 0x0: out.operation = out.x == 0 ? table0[out.kk] : OPERATION_NULL; break;
+        case 0x8: out.operation = out.n <= 0xE ? table8[out.n] : OPERATION_NULL; break;
+        case 0xE: out.operation = out.n <= 0xE ? tableE[out.n] : OPERATION_NULL; break;
+        case 0xD: out.operation = out.n == 0 ? OPERATION_Dxy0 : OPERATION_Dxyn; break;
+        case 0xF: out.operation = out.kk <= 0x85 ? tableF[out.kk] : OPERATION_NULL; break;
+        default:  out.operation = table[(opcode & 0xF000u) >> 12u]; break;
+    }
 
-	tableF[0x07] = &Chip8::OP_Fx07;
-	tableF[0x0A] = &Chip8::OP_Fx0A;
-	tableF[0x15] = &Chip8::OP_Fx15;
-	tableF[0x18] = &Chip8::OP_Fx18;
-	tableF[0x1E] = &Chip8::OP_Fx1E;
-	tableF[0x29] = &Chip8::OP_Fx29;
-	tableF[0x33] = &Chip8::OP_Fx33;
-	tableF[0x55] = &Chip8::OP_Fx55;
-	tableF[0x65] = &Chip8::OP_Fx65;
+    out.handler = handlers[out.operation];
+    out.length = 1;
 }
 
 /**
- * Load opcode table 0 data
+ * Turn a freshly decoded program space instruction into a superinstruction
+ * if it starts one of the common idioms. The instructions it covers keep
+ * their own cache entries, which the fused handler reads operands from, so
+ * a jump into the middle of a sequence runs on from that instruction's own
+ * entry as usual.
  */
-void Chip8::Table0() {
-    ((*this).*(table0[opcode & 0x000Fu]))();
+void Chip8::Fuse(uint16_t address, Instruction& entry) {
+    Operation next[MAX_FUSED_LENGTH - 1];
+    unsigned int available = 0;
+
+    // decode what follows, filling the cache entries the handler will use
+    while (available < MAX_FUSED_LENGTH - 1) {
+        unsigned int follower = address + (available + 1) * INSTRUCTION_WIDTH;
+        if (follower >= MEMORY_SIZE - 1) {
+            break;
+        }
+
+        Instruction& cached = decodeCache[follower - START_ADDRESS];
+        if (cached.handler == nullptr) {
+            Decode((memory[follower] << 8u) | memory[follower + 1], cached);
+            cached.length = 0; // still to be considered for fusion itself
+        }
+
+        // match on what the follower is on its own, even if it starts a fusion itself
+        Instruction plain;
+        Decode(cached.opcode, plain);
+        next[available++] = plain.operation;
+    }
+
+    Operation fused = entry.operation;
+    unsigned int length = 1;
+
+    switch (entry.operation) {
+        case OPERATION_Annn:
+            if (available >= 1 && next[0] == OPERATION_Dxyn) {
+                fused = OPERATION_Annn_Dxyn;
+                length = 2;
+            }
+            break;
+        case OPERATION_6xkk:
+            if (available >= 2 && next[0] == OPERATION_6xkk && next[1] == OPERATION_6xkk) {
+                fused = OPERATION_6xkk_6xkk_6xkk;
+                length = 3;
+            } else if (available >= 1 && next[0] == OPERATION_6xkk) {
+                fused = OPERATION_6xkk_6xkk;
+                length = 2;
+            }
+            break;
+        case OPERATION_7xkk:
+            if (available >= 1 && next[0] == OPERATION_3xkk) {
+                fused = OPERATION_7xkk_3xkk;
+                length = 2;
+            } else if (available >= 1 && next[0] == OPERATION_4xkk) {
+                fused = OPERATION_7xkk_4xkk;
+                length = 2;
+            }
+            break;
+        case OPERATION_Fx07:
+            if (available >= 2 && next[0] == OPERATION_3xkk && next[1] == OPERATION_1nnn) {
+                fused = OPERATION_Fx07_3xkk_1nnn;
+                length = 3;
+            } else if (available >= 2 && next[0] == OPERATION_4xkk && next[1] == OPERATION_1nnn) {
+                fused = OPERATION_Fx07_4xkk_1nnn;
+                length = 3;
+            }
+            break;
+        case OPERATION_Ex9E:
+            if (available >= 1 && next[0] == OPERATION_1nnn) {
+                fused = OPERATION_Ex9E_1nnn;
+                length = 2;
+            }
+            break;
+        case OPERATION_ExA1:
+            if (available >= 1 && next[0] == OPERATION_1nnn) {
+                fused = OPERATION_ExA1_1nnn;
+                length = 2;
+            }
+            break;
+        default:
+            break;
+    }
+
+    entry.operation = fused;
+    entry.handler = handlers[fused];
+    entry.length = length;
 }
 
 /**
- * Load opcode table 8 data
+ * Get the number of instructions in the idle loop starting at an address,
+ * or 0 if there isn't one. Idle loops only poll state that can't change
+ * while instructions run:
+ *     Fx07, 3xkk/4xkk, 1nnn back    wait for the delay timer
+ *     Ex9E/ExA1, 1nnn back          wait for a key
+ *     Fx0A                          wait for a key press
  */
-void Chip8::Table8() {
-    ((*this).*(table8[opcode & 0x000Fu]))();
+unsigned int Chip8::IdleLoopLength(uint16_t address) const {
+    if (address < START_ADDRESS || address + MAX_FUSED_LENGTH * INSTRUCTION_WIDTH > MEMORY_SIZE) {
+        return 0;
+    }
+
+    Instruction loop[MAX_FUSED_LENGTH];
+    for (unsigned int i = 0; i < MAX_FUSED_LENGTH; i++) {
+        uint16_t at = address + i * INSTRUCTION_WIDTH;
+        Decode((memory[at] << 8u) | memory[at + 1], loop[i]);
+    }
+
+    switch (loop[0].operation) {
+        case OPERATION_Fx07:
+            if ((loop[1].operation == OPERATION_3xkk || loop[1].operation == OPERATION_4xkk)
+                && loop[2].operation == OPERATION_1nnn && loop[2].nnn == address) {
+                return 3;
+            }
+            return 0;
+        case OPERATION_Ex9E:
+        case OPERATION_ExA1:
+            return loop[1].operation == OPERATION_1nnn && loop[1].nnn == address ? 2 : 0;
+        case OPERATION_Fx0A:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * Fast-forward an idle loop at pc that is going to keep spinning.
+ * Timers tick and keys change only between runs, so every remaining whole
+ * iteration within the budget would leave the machine exactly as it is;
+ * they are counted without being executed. Any part iteration is left to
+ * the caller, so instruction counts match running the loop for real.
+ * Returns the number of instructions skipped.
+ */
+uint32_t Chip8::SkipIdle(uint32_t budget) {
+    idle = false;
+
+    // traces see every instruction
+    if (IsTracing()) {
+        return 0;
+    }
+
+    unsigned int length = IdleLoopLength(pc);
+    if (length == 0 || budget < length) {
+        return 0;
+    }
+
+    Instruction head;
+    Instruction test;
+    Decode((memory[pc] << 8u) | memory[pc + 1], head);
+    Decode((memory[pc + 2] << 8u) | memory[pc + 3], test);
+
+    bool spinning = false;
+
+    switch (head.operation) {
+        case OPERATION_Fx07: {
+            // as it will be once Fx07 has run
+            uint8_t value = test.x == head.x ? delayTimer : V[test.x];
+            spinning = test.operation == OPERATION_3xkk ? value != test.kk : value == test.kk;
+            if (spinning) {
+                V[head.x] = delayTimer;
+            }
+        } break;
+        case OPERATION_Ex9E:
+        case OPERATION_ExA1: {
+            uint8_t key = V[head.x];
+            if (key < 16) {
+                spinning = head.operation == OPERATION_Ex9E ? !keypad[key] : keypad[key];
+            }
+        } break;
+        case OPERATION_Fx0A: {
+            if (keyWait != KEY_WAIT_NONE) {
+                // until the pressed key is released
+                spinning = keypad[keyWait];
+            } else {
+                // until any key goes down
+                spinning = true;
+                for (unsigned int key = 0; key < 16; key++) {
+                    if (keypad[key]) {
+                        spinning = false;
+                    }
+                }
+            }
+            if (spinning) {
+                waitingForKey = true;
+            }
+        } break;
+        default:
+            break;
+    }
+
+    if (!spinning) {
+        return 0;
+    }
+
+    return budget / length * length;
+}
+
+/**
+ * Drop decoded instructions that overlap a written memory range.
+ * An instruction at address - 1 reads the first written byte too, and a
+ * superinstruction reads up to MAX_FUSED_LENGTH instructions ahead.
+ */
+void Chip8::InvalidateCache(unsigned int address, unsigned int length) {
+    const unsigned int reach = MAX_FUSED_LENGTH * INSTRUCTION_WIDTH - 1;
+    unsigned int start = address > START_ADDRESS + reach ? address - reach : START_ADDRESS;
+    unsigned int end = address + length < MEMORY_SIZE ? address + length : MEMORY_SIZE;
+
+    for (unsigned int i = start; i < end; i++) {
+        decodeCache[i - START_ADDRESS].handler = nullptr;
+        decodeCache[i - START_ADDRESS].length = 0;
+    }
+
+    if (jit != nullptr) {
+        jit->Invalidate(address, length);
+    }
+
+    if (aot != nullptr) {
+        aot->Invalidate(address, length);
+    }
+}
+
+/**
+ * Seed the random number generator used by RND.
+ */
+void Chip8::SetSeed(uint64_t seed) {
+    // splitmix64 spreads weak seeds and never yields the all-zero state
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+
+    rngState = z != 0 ? z : 1;
 }
 
 /**
- * Load opcode table E data
+ * Enable or disable superinstructions.
+ * Everything decoded so far is dropped so the change applies at once.
  */
-void Chip8::TableE() {
-    ((*this).*(tableE[opcode & 0x000Fu]))();
+void Chip8::SetFusion(bool enabled) {
+    fusion = enabled;
+    InvalidateCache(START_ADDRESS, DECODE_CACHE_SIZE);
 }
 
 /**
- * Load opcode table F data
+ * Next random byte (xorshift64*).
  */
-void Chip8::TableF() {
-    ((*this).*(tableF[opcode & 0x00FFu]))();
+uint8_t Chip8::RandomByte() {
+    rngState ^= rngState >> 12;
+    rngState ^= rngState << 25;
+    rngState ^= rngState >> 27;
+
+    return (rngState * 0x2545F4914F6CDD1Dull) >> 56;
+}
+
+/**
+ * Copy the machine state into a snapshot.
+ */
+void Chip8::SaveState(Chip8State& state) const {
+    state = *this;
+}
+
+/**
+ * Hash of the machine state, for checking that two runs agree.
+ * Hashed field by field so struct padding never leaks in; the keypad is
+ * input rather than state and is left out. Memory and video, most of the
+ * state, go in a 64-bit word at a time, cheap enough to hash every frame.
+ */
+uint64_t Chip8::GetStateHash() const {
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    auto mix = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    };
+
+    auto mixWords = [&hash](const void* data, size_t size) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, &bytes[i], sizeof(word));
+            hash = (hash ^ word) * 0x9e3779b97f4a7c15ull;
+            hash ^= hash >> 32;
+        }
+    };
+
+    static_assert(sizeof(memory) % sizeof(uint64_t) == 0, "memory is hashed a word at a time");
+
+    mixWords(memory, sizeof(memory));
+    mixWords(video, sizeof(video));
+    mix(&rngState, sizeof(rngState));
+    mix(stack, sizeof(stack));
+    mix(&I, sizeof(I));
+    mix(&pc, sizeof(pc));
+    mix(V, sizeof(V));
+    mix(&sp, sizeof(sp));
+    mix(&delayTimer, sizeof(delayTimer));
+    mix(&soundTimer, sizeof(soundTimer));
+    mix(rplFlags, sizeof(rplFlags));
+    mix(&highRes, sizeof(highRes));
+    mix(&halted, sizeof(halted));
+    mix(&waitingForKey, sizeof(waitingForKey));
+    mix(&keyWait, sizeof(keyWait));
+
+    return hash;
+}
+
+/**
+ * Restore the machine state from a snapshot.
+ * Only code that actually differs from the snapshot is re-decoded.
+ */
+void Chip8::LoadState(const Chip8State& state) {
+    // find the changed span of memory, a 256 byte block at a time
+    const unsigned int block = 256;
+    unsigned int first = 0;
+    unsigned int last = MEMORY_SIZE;
+
+    while (first < last && memcmp(&memory[first], &state.memory[first], block) == 0) {
+        first += block;
+    }
+
+    while (last > first && memcmp(&memory[last - block], &state.memory[last - block], block) == 0) {
+        last -= block;
+    }
+
+    static_cast<Chip8State&>(*this) = state;
+
+    if (last > first) {
+        InvalidateCache(first, last - first);
+    }
+
+    MarkDirty(ALL_ROWS);
+}
+
+/**
+ * Write the machine state to a save file.
+ */
+bool Chip8::SaveState(const char* filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Unable to write save state: " << filename << std::endl;
+        return false;
+    }
+
+    SaveStateHeader header;
+    memcpy(header.magic, SAVE_STATE_MAGIC, sizeof(header.magic));
+    header.version = SAVE_STATE_VERSION;
+    header.size = sizeof(Chip8State);
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(static_cast<const Chip8State*>(this)), sizeof(Chip8State));
+
+    return file.good();
+}
+
+/**
+ * Read the machine state from a save file.
+ * Returns false, leaving the machine untouched, if the file is missing,
+ * truncated or from a different format version.
+ */
+bool Chip8::LoadState(const char* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Invalid save state: " << filename << std::endl;
+        return false;
+    }
+
+    SaveStateHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || memcmp(header.magic, SAVE_STATE_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "ERROR: Not a save state: " << filename << std::endl;
+        return false;
+    }
+
+    if (header.version != SAVE_STATE_VERSION || header.size != sizeof(Chip8State)) {
+        std::cerr << "ERROR: Save state version " << header.version << " is not supported (expected "
+                  << SAVE_STATE_VERSION << "): " << filename << std::endl;
+        return false;
+    }
+
+    Chip8State state;
+    if (!file.read(reinterpret_cast<char*>(&state), sizeof(state))) {
+        std::cerr << "ERROR: Truncated save state: " << filename << std::endl;
+        return false;
+    }
+
+    LoadState(state);
+    return true;
 }
 
 /**
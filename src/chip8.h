@@ -3,43 +3,221 @@
 
 #include <fstream>
 #include <cstdint>
-#include <random>
 #include <chrono>
 #include <cstring>
 #include <iostream>
+#include <type_traits>
+
+#include "trace.h"
+
+class Aot;
+class Jit;
 
 const unsigned int MEMORY_SIZE = 4096;
 const unsigned int RESERVED_MEMORY_SIZE = 512;
 
 const unsigned int START_ADDRESS = 0x200;
 const unsigned int FONTSET_START_ADDRESS = 0x50;
+const unsigned int BIG_FONTSET_START_ADDRESS = 0xA0;
 
 const unsigned int INSTRUCTION_WIDTH = 2;
 const unsigned int FONT_SIZE = 5; // fonts are 5 bytes
+const unsigned int BIG_FONT_SIZE = 10; // SCHIP fonts are 10 bytes
 
 const unsigned int VIDEO_WIDTH = 64;
 const unsigned int VIDEO_HEIGHT = 32;
 
+const unsigned int HIRES_VIDEO_WIDTH = 128; // SCHIP high resolution mode
+const unsigned int HIRES_VIDEO_HEIGHT = 64;
+const unsigned int VIDEO_ROW_WORDS = HIRES_VIDEO_WIDTH / 64;
+
 const unsigned int FONTSET_SIZE = 80;
+const unsigned int BIG_FONTSET_SIZE = 160;
+
+const unsigned int RPL_FLAGS = 8;
+
+const uint64_t ALL_ROWS = ~0ull; // dirty row mask covering the whole display
+
+const unsigned int FRAMES_PER_SECOND = 60; // timers tick once per frame
+const unsigned int DEFAULT_INSTRUCTIONS_PER_FRAME = 10;
+
+enum Engine {
+    ENGINE_INTERPRETER,
+    ENGINE_JIT,
+    ENGINE_AOT // a translation from chip8-aot linked into the binary
+};
+
+const char* const ENGINE_NAMES[] = {"interpreter", "jit", "aot"};
+
+// how the interpreter gets from a decoded instruction to its handler
+enum Dispatch {
+    DISPATCH_TABLE, // pointer-to-member handler stored in the decoded instruction
+    DISPATCH_SWITCH, // dense switch on the operation, handlers inlined
+    DISPATCH_GOTO // threaded code through computed goto (GCC/Clang)
+};
+
+const char* const DISPATCH_NAMES[] = {"table", "switch", "goto"};
+
+// chosen at build time, e.g. make DISPATCH=goto
+#ifndef CHIP8_DISPATCH
+#define CHIP8_DISPATCH DISPATCH_TABLE
+#endif
+
+/* Every instruction the decoder can produce, in Operation order.
+    X(name) is expanded for enums, handler tables and dispatch code. */
+#define CHIP8_OPERATIONS(X) \
+    X(NULL) X(00E0) X(00EE) X(00Cn) X(00FB) X(00FC) X(00FD) X(00FE) X(00FF) \
+    X(1nnn) X(2nnn) X(3xkk) X(4xkk) X(5xy0) X(6xkk) X(7xkk) \
+    X(8xy0) X(8xy1) X(8xy2) X(8xy3) X(8xy4) X(8xy5) X(8xy6) X(8xy7) X(8xyE) \
+    X(9xy0) X(Annn) X(Bnnn) X(Cxkk) X(Dxyn) X(Dxy0) X(Ex9E) X(ExA1) \
+    X(Fx07) X(Fx0A) X(Fx15) X(Fx18) X(Fx1E) X(Fx29) X(Fx30) X(Fx33) \
+    X(Fx55) X(Fx65) X(Fx75) X(Fx85) \
+    CHIP8_FUSED_OPERATIONS(X)
+
+/* Superinstructions for common idioms, executed by one handler.
+    They come last, from FIRST_FUSED_OPERATION on. */
+#define CHIP8_FUSED_OPERATIONS(X) \
+    X(Annn_Dxyn) X(6xkk_6xkk) X(6xkk_6xkk_6xkk) X(7xkk_3xkk) X(7xkk_4xkk) X(Fx07_3xkk_1nnn) \
+    X(Fx07_4xkk_1nnn) X(Ex9E_1nnn) X(ExA1_1nnn)
+
+enum Operation : uint8_t {
+#define CHIP8_OPERATION_ENUM(name) OPERATION_##name,
+    CHIP8_OPERATIONS(CHIP8_OPERATION_ENUM)
+#undef CHIP8_OPERATION_ENUM
+    OPERATION_COUNT
+};
+
+const Operation FIRST_FUSED_OPERATION = OPERATION_Annn_Dxyn;
+const unsigned int MAX_FUSED_LENGTH = 3; // instructions in the longest superinstruction
+
+const char* const OPERATION_NAMES[] = {
+#define CHIP8_OPERATION_NAME(name) #name,
+    CHIP8_OPERATIONS(CHIP8_OPERATION_NAME)
+#undef CHIP8_OPERATION_NAME
+};
+
+const unsigned int DECODE_CACHE_SIZE = MEMORY_SIZE - START_ADDRESS; // one entry per program address
+
+const char SAVE_STATE_MAGIC[4] = {'C', '8', 'S', 'T'};
+const uint32_t SAVE_STATE_VERSION = 2; // bump whenever Chip8State changes
+
+const uint8_t KEY_WAIT_NONE = 0xFF; // no key pressed yet during an Fx0A wait
+
+/**
+ * Complete machine state as one POD block.
+ * Snapshots are a plain struct copy; save files are a SaveStateHeader
+ * followed by this block in host byte order.
+ */
+struct Chip8State {
+    uint8_t memory[MEMORY_SIZE]; // 4096 bytes of memory
+    /* - 0x200 to 0xFFF is program space
+       - 0x000 to 0x1FF is reserved
+           - 0x050 to 0x0A0 stores 16 built-in chars
+           - 0x0A0 to 0x140 stores the SCHIP 8x10 digits */
+
+    uint64_t video[HIRES_VIDEO_HEIGHT][VIDEO_ROW_WORDS]; // 64x32 or 128x64 video output
+    /* monochrome video, one bit per pixel. each row is two words,
+        with the leftmost pixel in the most significant bit of the first.
+        in low resolution only the first 32 rows of the first word are used. */
+
+    uint64_t rngState; // xorshift64* state for RND
+
+    uint16_t stack[16]; // 16 level stack (16 bit)
+
+    uint16_t I; // special 16-bit index register
+    /* stores an address. needed because 8-bit registers can't store
+        largest location. 
+        usually only uses lower 12 bits. (2^12 = 4096)*/
+
+    uint16_t pc; // 16-bit program counter
+
+    uint8_t V[16]; // 16 8-bit registers
+    /* V0 to VF, 0x00 to 0xFF
+        VF is used as a flag */
+
+    uint8_t sp; // 8-bit stack pointer
+
+    uint8_t delayTimer;
+    uint8_t soundTimer;
 
-class Chip8 {
+    uint8_t keypad[16]; // 16 character keypad
+
+    uint8_t rplFlags[RPL_FLAGS]; // SCHIP user flags
+
+    bool highRes; // SCHIP 128x64 mode
+    bool halted; // SCHIP EXIT executed
+
+    bool waitingForKey; // stopped at Fx0A
+    uint8_t keyWait; // key pressed during the wait, reported once released
+};
+
+static_assert(std::is_trivially_copyable<Chip8State>::value, "Chip8State must stay a flat copyable block");
+
+struct SaveStateHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t size; // sizeof(Chip8State)
+};
+
+class Chip8 : private Chip8State {
 public:
     Chip8();
     ~Chip8();
 
     void Cycle();
-    void LoadROM(const char* filename);
+    uint32_t Run(uint32_t instructions);
+    uint32_t RunFrame(uint32_t instructionsPerFrame);
+    void TickTimers();
+    bool LoadROM(const char* filename);
+    bool LoadProgram(const uint8_t* data, size_t size);
+    void SetTrace(Trace* trace);
+    bool SetEngine(Engine engine);
 
     void MemoryDump();
 
-    uint8_t keypad[16]; // 16 character keypad
+    // snapshots
+    void SaveState(Chip8State& state) const;
+    void LoadState(const Chip8State& state);
+    bool SaveState(const char* filename) const;
+    bool LoadState(const char* filename);
+    uint64_t GetStateHash() const;
+
+    void SetSeed(uint64_t seed);
+
+    // superinstructions, on by default
+    void SetFusion(bool enabled);
+    uint64_t GetFusionCount(Operation operation) const { return fusions[operation]; }
+
+    // read-only register access for tools
+    const uint8_t* GetRegisters() const { return V; }
+    uint16_t GetIndex() const { return I; }
+    uint16_t GetPC() const { return pc; }
+    uint8_t GetSP() const { return sp; }
+
+    // current display mode
+    unsigned int GetVideoWidth() const { return highRes ? HIRES_VIDEO_WIDTH : VIDEO_WIDTH; }
+    unsigned int GetVideoHeight() const { return highRes ? HIRES_VIDEO_HEIGHT : VIDEO_HEIGHT; }
+    bool IsHalted() const { return halted; }
+    bool IsWaitingForKey() const { return waitingForKey; }
+    uint8_t GetDelayTimer() const { return delayTimer; }
+    uint8_t GetSoundTimer() const { return soundTimer; }
+
+    // display change tracking, bit y of the mask is row y
+    uint64_t GetFrameGeneration() const { return frameGeneration; }
+    uint64_t TakeDirtyRows() { uint64_t rows = dirtyRows; dirtyRows = 0; return rows; }
 
-    uint32_t video[VIDEO_WIDTH * VIDEO_HEIGHT]; // 64x32 video output
-    /* monochrome video. each 32-bit pixel is on or off.*/
+    using Chip8State::keypad;
+    using Chip8State::video;
 
     void OP_NULL(); // NULL OP
     void OP_00E0(); // CLS
     void OP_00EE(); // RET
+    void OP_00Cn(); // SCD nibble
+    void OP_00FB(); // SCR
+    void OP_00FC(); // SCL
+    void OP_00FD(); // EXIT
+    void OP_00FE(); // LOW
+    void OP_00FF(); // HIGH
     void OP_1nnn(); // JP addr
     void OP_2nnn(); // CALL addr
     void OP_3xkk(); // SE Vx, byte
@@ -61,6 +239,7 @@ public:
     void OP_Bnnn(); // JP V0, addr
     void OP_Cxkk(); // RND Vx, byte
     void OP_Dxyn(); // DRW Vx, Vy, nibble
+    void OP_Dxy0(); // DRW Vx, Vy, 0
     void OP_Ex9E(); // SKP Vx
     void OP_ExA1(); // SKNP Vx
     void OP_Fx07(); // LD Vx, DT
@@ -69,52 +248,85 @@ public:
     void OP_Fx18(); // LD ST, Vx
     void OP_Fx1E(); // ADD I, Vx
     void OP_Fx29(); // LD F, Vx
+    void OP_Fx30(); // LD HF, Vx
     void OP_Fx33(); // LD B, Vx
     void OP_Fx55(); // LD [I], Vx
     void OP_Fx65(); // LD Vx, [I]
+    void OP_Fx75(); // LD R, Vx
+    void OP_Fx85(); // LD Vx, R
+
+    void OP_Annn_Dxyn(); // LD I, addr; DRW Vx, Vy, nibble
+    void OP_6xkk_6xkk(); // LD Vx, byte; LD Vx, byte
+    void OP_6xkk_6xkk_6xkk(); // LD Vx, byte x3
+    void OP_7xkk_3xkk(); // ADD Vx, byte; SE Vx, byte
+    void OP_7xkk_4xkk(); // ADD Vx, byte; SNE Vx, byte
+    void OP_Fx07_3xkk_1nnn(); // LD Vx, DT; SE Vx, byte; JP addr
+    void OP_Fx07_4xkk_1nnn(); // LD Vx, DT; SNE Vx, byte; JP addr
+    void OP_Ex9E_1nnn(); // SKP Vx; JP addr
+    void OP_ExA1_1nnn(); // SKNP Vx; JP addr
 
 private:
-    uint8_t memory[MEMORY_SIZE]; // 4096 bytes of memory
-    /* - 0x200 to 0xFFF is program space
-       - 0x000 to 0x1FF is reserved
-           - 0x050 to 0x0A0 stores 16 built-in chars */
+    friend class Jit;
+    friend class Aot;
+    friend class AotTranslator;
+    friend class LaneGroup;
 
-    uint8_t V[16]; // 16 8-bit registers
-    /* V0 to VF, 0x00 to 0xFF
-        VF is used as a flag */
+    uint16_t opcode; // current opcode
 
-    uint16_t I; // special 16-bit index register
-    /* stores an address. needed because 8-bit registers can't store
-        largest location. 
-        usually only uses lower 12 bits. (2^12 = 4096)*/
-    
-    uint16_t pc; // 16-bit program counter
+    // opcode tables, resolving opcodes to operations
+    typedef void (Chip8::*Chip8Func)();
+    Operation  table[0xF  + 1];
+    Operation table0[0xFF + 1];
+    Operation table8[0xE  + 1];
+    Operation tableE[0xE  + 1];
+    Operation tableF[0x85 + 1];
 
-    uint8_t sp; // 8-bit stack pointer
+    Chip8Func handlers[OPERATION_COUNT]; // keyed by operation
 
-    uint16_t stack[16]; // 16 level stack (16 bit)
+    // predecoded instruction
+    struct Instruction {
+        Chip8Func handler; // resolved handler, nullptr if not decoded
+        Operation operation; // same instruction, for switch and goto dispatch
+        uint8_t length; // instructions covered, more than one when fused, 0 if not fetched yet
+        uint16_t opcode;
+        uint16_t nnn;
+        uint8_t x;
+        uint8_t y;
+        uint8_t n;
+        uint8_t kk;
+    };
 
-    uint16_t opcode; // current opcode
+    Instruction decodeCache[DECODE_CACHE_SIZE]; // keyed by address - START_ADDRESS
+    Instruction decodeScratch; // for code outside program space
+    const Instruction* instr; // instruction being executed
+    /* fused handlers step instr through the entries of the instructions
+        they cover, and leave it on the last one they executed */
 
-    uint8_t delayTimer;
-    uint8_t soundTimer;
+    bool idle; // a handler just went round a loop that may only be polling
+    bool fusion; // build superinstructions when filling the decode cache
+    uint64_t fusions[OPERATION_COUNT]; // times each superinstruction ran
 
-    std::default_random_engine randGen;
-	std::uniform_int_distribution<uint8_t> randByte;
+    uint64_t dirtyRows; // rows changed since the last TakeDirtyRows
+    uint64_t frameGeneration; // bumped by every display change
 
-    // opcode tables
-    typedef void (Chip8::*Chip8Func)();
-    Chip8Func  table[0xF  + 1];
-    Chip8Func table0[0xE  + 1];
-    Chip8Func table8[0xE  + 1];
-    Chip8Func tableE[0xE  + 1];
-    Chip8Func tableF[0x65 + 1];
+    Trace* trace; // optional instruction trace, not owned
+    Jit* jit; // recompiler, nullptr when interpreting
+    Aot* aot; // ahead-of-time translation, nullptr when not in use
 
     void LoadOpcodeTables();
-    void Table0();
-    void Table8();
-    void TableE();
-    void TableF();
+    void Decode(uint16_t opcode, Instruction& out) const;
+    const Instruction& Fetch(uint16_t address);
+    void Fuse(uint16_t address, Instruction& entry);
+    const Instruction* Next(uint32_t budget);
+    void StepFused() { instr += INSTRUCTION_WIDTH; pc += INSTRUCTION_WIDTH; }
+    bool IsTracing() const { return trace != nullptr && trace->GetLevel() != TRACE_OFF; }
+    unsigned int IdleLoopLength(uint16_t address) const;
+    uint32_t SkipIdle(uint32_t budget);
+    template <Dispatch dispatch> uint32_t Interpret(uint32_t instructions);
+    void InvalidateCache(unsigned int address, unsigned int length);
+    uint64_t BlitRow(unsigned int y, uint64_t sprite, unsigned int xPos);
+    void MarkDirty(uint64_t rows) { dirtyRows |= rows; frameGeneration++; }
+    uint8_t RandomByte();
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+#include "chip8audio.h"
+#include "chip8.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <iostream>
+
+Chip8_Audio::Chip8_Audio(int bufferSamples)
+    : device(0), sampleRate(AUDIO_SAMPLE_RATE), bufferSamples(bufferSamples), published(0), rejected(0),
+      current{false, 0}, samplesLeft(0), phase(0), level(0), held(0), dropped(0), played(0), latencyTotal(0), latencyMax(0) {
+    if (bufferSamples <= 0) {
+        return; // sound off
+    }
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
+        std::cerr << "WARNING: No audio: " << SDL_GetError() << std::endl;
+        return;
+    }
+
+    SDL_AudioSpec wanted = {};
+    wanted.freq = AUDIO_SAMPLE_RATE;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = bufferSamples;
+    wanted.callback = Callback;
+    wanted.userdata = this;
+
+    SDL_AudioSpec obtained;
+    device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained,
+                                 SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (device == 0) {
+        std::cerr << "WARNING: No audio: " << SDL_GetError() << std::endl;
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return;
+    }
+
+    sampleRate = obtained.freq;
+    this->bufferSamples = obtained.samples;
+
+    SDL_PauseAudioDevice(device, 0);
+}
+
+Chip8_Audio::~Chip8_Audio() {
+    if (device != 0) {
+        // waits for a running callback to return
+        SDL_CloseAudioDevice(device);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+    }
+}
+
+/**
+ * Queue the buzzer state of the frame just run.
+ * Frames are dropped, never waited for, if the callback has stopped
+ * taking them.
+ */
+void Chip8_Audio::Publish(bool on) {
+    if (device == 0) {
+        return;
+    }
+
+    if (events.Push({on, FrameScheduler::Now()})) {
+        published++;
+    } else {
+        rejected++;
+    }
+}
+
+void Chip8_Audio::Callback(void* userdata, Uint8* stream, int length) {
+    static_cast<Chip8_Audio*>(userdata)->Fill(reinterpret_cast<int16_t*>(stream), length / sizeof(int16_t));
+}
+
+/**
+ * Move on to the next queued frame, if there is one, noting its latency
+ * as if sample were the one it starts on. Returns false if the queue was
+ * empty.
+ */
+bool Chip8_Audio::NextFrame(int64_t now, int sample) {
+    // fast-forwarded, skip to the recent frames
+    while (events.Size() > AUDIO_MAX_BACKLOG) {
+        events.Pop(current);
+        dropped++;
+    }
+
+    if (!events.Pop(current)) {
+        return false;
+    }
+
+    // played one device buffer after this one, at the given sample
+    int64_t output = now + static_cast<int64_t>(bufferSamples + sample) * 1000000000ll / sampleRate;
+    int64_t latency = output - current.time;
+
+    latencyTotal += latency;
+    latencyMax = std::max(latencyMax, latency);
+    played++;
+
+    return true;
+}
+
+/**
+ * Audio thread: generate count samples.
+ */
+void Chip8_Audio::Fill(int16_t* samples, int count) {
+    const double samplesPerFrame = static_cast<double>(sampleRate) / FRAMES_PER_SECOND;
+    const double ramp = 1.0 / (AUDIO_RAMP_MS * sampleRate / 1000.0);
+    const double step = AUDIO_TONE_HZ / sampleRate;
+
+    int64_t now = FrameScheduler::Now();
+
+    for (int i = 0; i < count; i++) {
+        if (samplesLeft <= 0) {
+            if (NextFrame(now, i)) {
+                held = 0;
+            } else if (++held > AUDIO_HOLD_FRAMES) {
+                // nothing new for a while, paused or blocked
+                current.on = false;
+            }
+            samplesLeft += samplesPerFrame;
+        }
+        samplesLeft--;
+
+        double target = current.on ? AUDIO_VOLUME : 0.0;
+        level = level < target ? std::min(level + ramp * AUDIO_VOLUME, target) : std::max(level - ramp * AUDIO_VOLUME, target);
+
+        phase += step;
+        if (phase >= 1.0) {
+            phase -= 1.0;
+        }
+
+        samples[i] = static_cast<int16_t>((phase < 0.5 ? level : -level) * INT16_MAX);
+    }
+}
+
+/**
+ * Report how the audio kept up. Call once the emulation thread is done.
+ */
+void Chip8_Audio::PrintStats() {
+    if (device == 0) {
+        return;
+    }
+
+    // stop the callback, so its counters can be read
+    SDL_PauseAudioDevice(device, 1);
+    SDL_LockAudioDevice(device);
+    SDL_UnlockAudioDevice(device);
+
+    printf("Audio: %d Hz, %d sample buffer (%.1f ms)\n", sampleRate, bufferSamples, bufferSamples * 1000.0 / sampleRate);
+    if (played > 0) {
+        printf("Audio latency: %.1f ms average, %.1f ms worst over %llu frames\n", latencyTotal / 1e6 / played,
+               latencyMax / 1e6, static_cast<unsigned long long>(played));
+    }
+    printf("Audio frames: %llu published, %llu dropped catching up, %llu rejected by a full queue\n",
+           static_cast<unsigned long long>(published), static_cast<unsigned long long>(dropped),
+           static_cast<unsigned long long>(rejected));
+}
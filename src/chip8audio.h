@@ -0,0 +1,73 @@
+#ifndef CHIP8_AUDIO_H
+#define CHIP8_AUDIO_H
+
+#include <SDL2/SDL.h>
+
+#include <cstdint>
+
+#include "spscring.h"
+
+const int AUDIO_SAMPLE_RATE = 48000;
+const int DEFAULT_AUDIO_BUFFER = 512; // samples per callback, about 11 ms
+const double AUDIO_TONE_HZ = 440.0;
+const double AUDIO_VOLUME = 0.25; // of full scale
+const double AUDIO_RAMP_MS = 2.0; // fade in and out, so the tone never clicks
+const unsigned int AUDIO_HOLD_FRAMES = 2; // starved frames that repeat the last one before going quiet
+const unsigned int AUDIO_MAX_BACKLOG = 3; // frames queued beyond this are dropped, to bound latency
+const size_t AUDIO_RING_SIZE = 64;
+
+/**
+ * Buzzer state for one 60 Hz frame.
+ */
+struct ToneEvent {
+    bool on; // sound timer was running
+    int64_t time; // FrameScheduler::Now() when the frame was published
+};
+
+/**
+ * Buzzer output. The emulation thread publishes one ToneEvent per frame
+ * into a lock-free ring, and the SDL audio callback plays each for 1/60 s
+ * of samples as a square wave.
+ *
+ * The callback keeps latency bounded by dropping the oldest frames when
+ * too many are queued (fast-forward) and rides out short gaps by holding
+ * the last frame before fading to silence (pauses, slow frames).
+ */
+class Chip8_Audio {
+public:
+    Chip8_Audio(int bufferSamples);
+    ~Chip8_Audio();
+
+    bool IsOpen() const { return device != 0; }
+
+    // emulation thread, never blocks
+    void Publish(bool on);
+
+    void PrintStats();
+
+private:
+    static void Callback(void* userdata, Uint8* stream, int length);
+    void Fill(int16_t* samples, int count);
+    bool NextFrame(int64_t now, int sample);
+
+    SDL_AudioDeviceID device;
+    int sampleRate;
+    int bufferSamples;
+
+    SpscRing<ToneEvent, AUDIO_RING_SIZE> events;
+    uint64_t published; // emulation thread only
+    uint64_t rejected; // frames the full ring turned away, emulation thread only
+
+    // audio thread only
+    ToneEvent current;
+    double samplesLeft; // of the current frame
+    double phase; // of the square wave, 0 to 1
+    double level; // current amplitude, ramps toward the frame's
+    unsigned int held; // frames the current one has been repeated for
+    uint64_t dropped; // frames skipped to catch up
+    uint64_t played;
+    int64_t latencyTotal; // nanoseconds, publish to output, over played frames
+    int64_t latencyMax;
+};
+
+#endif
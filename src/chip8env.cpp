@@ -0,0 +1,257 @@
+#include "chip8env.h"
+
+#include "chip8.h"
+#include "threadpool.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+static_assert(CHIP8_ENV_WIDTH == VIDEO_WIDTH && CHIP8_ENV_HEIGHT == VIDEO_HEIGHT,
+              "observations are low resolution frames");
+
+const unsigned int ENV_MIN_PER_TASK = 16; // fewer environments than this per thread step inline
+
+struct chip8_env {
+    std::vector<std::unique_ptr<Chip8>> machines;
+    std::vector<const uint8_t*> rendered; // where each frame was last written, nullptr if nowhere
+    Chip8State initial; // the ROM loaded, nothing run
+    unsigned int instructionsPerFrame;
+    unsigned int frameSkip;
+    std::unique_ptr<ThreadPool> pool; // nullptr when stepping on the calling thread
+};
+
+/**
+ * One byte per pixel for each value of a byte of video, leftmost pixel
+ * first.
+ */
+struct PixelTable {
+    uint64_t bytes[256];
+
+    PixelTable() {
+        for (unsigned int value = 0; value < 256; value++) {
+            bytes[value] = 0;
+            for (unsigned int pixel = 0; pixel < 8; pixel++) {
+                bytes[value] |= static_cast<uint64_t>((value >> (7 - pixel)) & 1u) << (pixel * 8);
+            }
+        }
+    }
+};
+
+static const PixelTable PIXELS;
+
+/**
+ * Halve a 64 pixel word to 32, a pixel being on if either of the two it
+ * covers is.
+ */
+static uint32_t HalveRow(uint64_t word) {
+    word = (word | (word >> 1)) & 0x5555555555555555ull;
+    word = (word | (word >> 1)) & 0x3333333333333333ull;
+    word = (word | (word >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+    word = (word | (word >> 4)) & 0x00FF00FF00FF00FFull;
+    word = (word | (word >> 8)) & 0x0000FFFF0000FFFFull;
+    word = (word | (word >> 16)) & 0x00000000FFFFFFFFull;
+    return static_cast<uint32_t>(word);
+}
+
+/**
+ * Write environment index's frame to out. Only rows changed since it
+ * was last written there are rewritten.
+ */
+static void Render(chip8_env* env, unsigned int index, uint8_t* out) {
+    Chip8& chip8 = *env->machines[index];
+    uint64_t rows = chip8.TakeDirtyRows();
+
+    if (env->rendered[index] != out) {
+        rows = ALL_ROWS;
+        env->rendered[index] = out;
+    }
+
+    if (rows == 0) {
+        return;
+    }
+
+    bool highRes = chip8.GetVideoWidth() == HIRES_VIDEO_WIDTH;
+
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; y++) {
+        uint64_t word;
+
+        if (highRes) {
+            if (((rows >> (y * 2)) & 3u) == 0) {
+                continue;
+            }
+
+            const uint64_t* top = chip8.video[y * 2];
+            const uint64_t* bottom = chip8.video[y * 2 + 1];
+            word = static_cast<uint64_t>(HalveRow(top[0] | bottom[0])) << 32 | HalveRow(top[1] | bottom[1]);
+        } else {
+            if (((rows >> y) & 1u) == 0) {
+                continue;
+            }
+
+            word = chip8.video[y][0];
+        }
+
+        uint8_t* row = out + y * VIDEO_WIDTH;
+        for (unsigned int byte = 0; byte < 8; byte++) {
+            memcpy(row + byte * 8, &PIXELS.bytes[(word >> (56 - byte * 8)) & 0xFF], 8);
+        }
+    }
+}
+
+/**
+ * Call task(first, last) over every environment, split across the pool.
+ */
+template <typename Task>
+static void ForEach(chip8_env* env, Task task) {
+    unsigned int count = env->machines.size();
+
+    if (!env->pool || count < ENV_MIN_PER_TASK * 2) {
+        task(0u, count);
+        return;
+    }
+
+    unsigned int tasks = std::min(env->pool->Size(), count / ENV_MIN_PER_TASK);
+    unsigned int chunk = (count + tasks - 1) / tasks;
+
+    for (unsigned int first = 0; first < count; first += chunk) {
+        unsigned int last = std::min(first + chunk, count);
+        env->pool->Submit([&task, first, last]() { task(first, last); });
+    }
+
+    env->pool->Wait();
+}
+
+static void ResetOne(chip8_env* env, unsigned int index, uint64_t seed, uint8_t* observations) {
+    Chip8& chip8 = *env->machines[index];
+
+    chip8.LoadState(env->initial);
+    chip8.SetSeed(seed);
+
+    if (observations) {
+        Render(env, index, observations + static_cast<size_t>(index) * CHIP8_ENV_FRAME_SIZE);
+    }
+}
+
+chip8_env* chip8_env_create(const char* rom, unsigned int count, const chip8_env_config* config) {
+    if (count == 0) {
+        std::cerr << "ERROR: No environments requested" << std::endl;
+        return nullptr;
+    }
+
+    chip8_env_config defaults = {0, 0, 0, 0};
+    if (!config) {
+        config = &defaults;
+    }
+
+    std::unique_ptr<chip8_env> env(new chip8_env());
+
+    std::unique_ptr<Chip8> first(new Chip8());
+    if (!first->LoadROM(rom)) {
+        return nullptr;
+    }
+    first->SaveState(env->initial);
+
+    env->instructionsPerFrame = config->instructions_per_frame ? config->instructions_per_frame : DEFAULT_INSTRUCTIONS_PER_FRAME;
+    env->frameSkip = config->frame_skip ? config->frame_skip : 1;
+
+    env->machines.push_back(std::move(first));
+    while (env->machines.size() < count) {
+        env->machines.emplace_back(new Chip8());
+        env->machines.back()->LoadState(env->initial);
+    }
+    env->rendered.assign(count, nullptr);
+
+    if (config->jit) {
+        for (auto& chip8 : env->machines) {
+            if (!chip8->SetEngine(ENGINE_JIT)) {
+                std::cerr << "WARNING: JIT not available on this host, using the interpreter\n";
+                break;
+            }
+        }
+    }
+
+    if (config->threads != 1) {
+        env->pool.reset(new ThreadPool(config->threads));
+    }
+
+    chip8_env_reset(env.get(), 0, nullptr);
+
+    return env.release();
+}
+
+void chip8_env_destroy(chip8_env* env) {
+    delete env;
+}
+
+unsigned int chip8_env_count(const chip8_env* env) {
+    return env ? env->machines.size() : 0;
+}
+
+int chip8_env_reset(chip8_env* env, uint64_t seed, uint8_t* observations) {
+    if (!env) {
+        return -1;
+    }
+
+    ForEach(env, [env, seed, observations](unsigned int first, unsigned int last) {
+        for (unsigned int i = first; i < last; i++) {
+            ResetOne(env, i, seed + i, observations);
+        }
+    });
+
+    return 0;
+}
+
+int chip8_env_reset_one(chip8_env* env, unsigned int index, uint64_t seed, uint8_t* observations) {
+    if (!env || index >= env->machines.size()) {
+        return -1;
+    }
+
+    ResetOne(env, index, seed, observations);
+
+    return 0;
+}
+
+int chip8_env_step(chip8_env* env, const uint16_t* actions, uint8_t* observations, uint8_t* dones) {
+    if (!env || !actions) {
+        return -1;
+    }
+
+    ForEach(env, [env, actions, observations, dones](unsigned int first, unsigned int last) {
+        for (unsigned int i = first; i < last; i++) {
+            Chip8& chip8 = *env->machines[i];
+
+            for (unsigned int key = 0; key < 16; key++) {
+                chip8.keypad[key] = (actions[i] >> key) & 1u;
+            }
+
+            for (unsigned int frame = 0; frame < env->frameSkip && !chip8.IsHalted(); frame++) {
+                chip8.RunFrame(env->instructionsPerFrame);
+            }
+
+            if (observations) {
+                Render(env, i, observations + static_cast<size_t>(i) * CHIP8_ENV_FRAME_SIZE);
+            }
+
+            if (dones) {
+                dones[i] = chip8.IsHalted() ? 1 : 0;
+            }
+        }
+    });
+
+    return 0;
+}
+
+int chip8_env_render(chip8_env* env, uint8_t* observations) {
+    if (!env || !observations) {
+        return -1;
+    }
+
+    ForEach(env, [env, observations](unsigned int first, unsigned int last) {
+        for (unsigned int i = first; i < last; i++) {
+            Render(env, i, observations + static_cast<size_t>(i) * CHIP8_ENV_FRAME_SIZE);
+        }
+    });
+
+    return 0;
+}
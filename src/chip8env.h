@@ -0,0 +1,67 @@
+#ifndef CHIP8ENV_H
+#define CHIP8ENV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * C API for reinforcement learning: a batch of headless emulators running
+ * one ROM, stepped together.
+ *
+ * Observations are CHIP8_ENV_WIDTH x CHIP8_ENV_HEIGHT bytes per
+ * environment, one byte per pixel (0 or 1), row major, written back to
+ * back into a caller-provided buffer of count * CHIP8_ENV_FRAME_SIZE
+ * bytes. SCHIP high resolution frames are halved, a pixel being on if any
+ * of the four it covers is. Actions are one uint16_t per environment, bit
+ * k holding key k down for the whole step.
+ *
+ * A frame written to the same place as last time only has its changed
+ * rows rewritten, so the caller must not modify observations in place.
+ *
+ * Built as libchip8env.so (make env); python/chip8env.py wraps it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    CHIP8_ENV_WIDTH = 64,
+    CHIP8_ENV_HEIGHT = 32,
+    CHIP8_ENV_FRAME_SIZE = CHIP8_ENV_WIDTH * CHIP8_ENV_HEIGHT
+};
+
+typedef struct chip8_env chip8_env;
+
+typedef struct {
+    unsigned int instructions_per_frame; /* 0 = the emulator's default */
+    unsigned int frame_skip; /* 60 Hz frames run per step, 0 = 1 */
+    unsigned int threads; /* 0 = one per core, 1 = step on the calling thread */
+    int jit; /* run on the x86-64 recompiler where available */
+} chip8_env_config;
+
+/* NULL if the ROM can't be loaded; config may be NULL for the defaults */
+chip8_env* chip8_env_create(const char* rom, unsigned int count, const chip8_env_config* config);
+void chip8_env_destroy(chip8_env* env);
+
+unsigned int chip8_env_count(const chip8_env* env);
+
+/* restart every environment, environment i seeded with seed + i;
+   observations may be NULL */
+int chip8_env_reset(chip8_env* env, uint64_t seed, uint8_t* observations);
+
+/* restart one environment, e.g. once it is done */
+int chip8_env_reset_one(chip8_env* env, unsigned int index, uint64_t seed, uint8_t* observations);
+
+/* run frame_skip frames with the given keys held; dones gets one byte per
+   environment, 1 once its ROM has exited. observations and dones may be NULL */
+int chip8_env_step(chip8_env* env, const uint16_t* actions, uint8_t* observations, uint8_t* dones);
+
+/* write the current frames without stepping */
+int chip8_env_render(chip8_env* env, uint8_t* observations);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,6 +1,10 @@
 #include "chip8video.h"
+#include "scheduler.h"
 
-Chip8_Video::Chip8_Video(int windowWidth, int windowHeight, int textureWidth, int textureHeight) {
+#include <algorithm>
+
+Chip8_Video::Chip8_Video(int windowWidth, int windowHeight, int textureWidth, int textureHeight)
+    : textureWidth(textureWidth), textureHeight(textureHeight), presentPending(false), lastPresent(0), rewindHeld(false) {
     // initialize SDL video
     SDL_Init(SDL_INIT_VIDEO);
 
@@ -9,6 +13,16 @@ Chip8_Video::Chip8_Video(int windowWidth, int windowHeight, int textureWidth, in
     renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
 
     texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
+
+    memset(pixels, 0, sizeof(pixels));
+
+    // presents are limited to the refresh rate of the window's display
+    SDL_DisplayMode mode;
+    refreshRate = 60;
+    if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &mode) == 0 && mode.refresh_rate > 0) {
+        refreshRate = mode.refresh_rate;
+    }
+    presentInterval = SDL_GetPerformanceFrequency() / refreshRate;
 }
 
 Chip8_Video::~Chip8_Video() {
@@ -20,167 +34,125 @@ Chip8_Video::~Chip8_Video() {
 
 /**
  * Update the video display.
+ * Only the rows in dirtyRows are expanded to RGBA8888 in the staging
+ * buffer, and only the span between the first and last of them is
+ * uploaded. The texture is recreated when the resolution changes.
  */
-void Chip8_Video::Update(const void* buffer, int pitch) {
-    SDL_UpdateTexture(texture, nullptr, buffer, pitch);
+void Chip8_Video::Update(const uint64_t (*video)[VIDEO_ROW_WORDS], int width, int height, uint64_t dirtyRows) {
+    if (width != textureWidth || height != textureHeight) {
+        SDL_DestroyTexture(texture);
+        textureWidth = width;
+        textureHeight = height;
+        texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
+        dirtyRows = ALL_ROWS; // new texture has no contents
+    }
+
+    if (height < 64) {
+        dirtyRows &= (1ull << height) - 1;
+    }
+
+    if (dirtyRows == 0) {
+        return;
+    }
+
+    int first = __builtin_ctzll(dirtyRows);
+    int last = 63 - __builtin_clzll(dirtyRows);
+
+    for (int y = first; y <= last; y++) {
+        if (!((dirtyRows >> y) & 1u)) {
+            continue;
+        }
+
+        uint32_t* out = &pixels[y * textureWidth];
+        const uint64_t* row = video[y];
+
+        for (int x = 0; x < textureWidth; x++) {
+            out[x] = (row[x >> 6] >> (63 - (x & 63))) & 1u ? 0xFFFFFFFF : 0x00000000;
+        }
+    }
+
+    SDL_Rect rows = {0, first, textureWidth, last - first + 1};
+    SDL_UpdateTexture(texture, &rows, &pixels[first * textureWidth], textureWidth * sizeof(uint32_t));
+
+    presentPending = true;
+}
+
+/**
+ * Present the texture if it changed, at most once per display refresh.
+ * Returns true if it was presented.
+ */
+bool Chip8_Video::Render() {
+    if (!presentPending) {
+        return false;
+    }
+
+    uint64_t now = SDL_GetPerformanceCounter();
+    if (now - lastPresent < presentInterval) {
+        return false; // still pending, picked up by the next call
+    }
+
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
     SDL_RenderPresent(renderer);
+
+    lastPresent = now;
+    presentPending = false;
+
+    return true;
 }
 
 /**
- * Handle keypad input.
+ * Block until an event arrives or the timeout passes.
+ * The event is left queued for HandleInput.
+ * Returns true if there is an event.
  */
-bool Chip8_Video::HandleInput(uint8_t* keypad) {
+bool Chip8_Video::WaitForInput(int timeoutMs) {
+    return SDL_WaitEventTimeout(nullptr, timeoutMs) == 1;
+}
+
+// host key for each keypad key, 0-F
+static const SDL_Keycode KEYMAP[16] = {
+    SDLK_x, SDLK_1, SDLK_2, SDLK_3,
+    SDLK_q, SDLK_w, SDLK_e, SDLK_a,
+    SDLK_s, SDLK_d, SDLK_z, SDLK_c,
+    SDLK_4, SDLK_r, SDLK_f, SDLK_v,
+};
+
+/**
+ * Handle pending events. Keypad transitions are appended to inputs,
+ * stamped with the time SDL saw them on the FrameScheduler::Now() clock.
+ * Returns true if the user asked to quit.
+ */
+bool Chip8_Video::HandleInput(std::vector<KeyInput>& inputs) {
     bool quit = false;
     SDL_Event event;
 
-	while (SDL_PollEvent(&event)) {
-		switch (event.type) {
-			case SDL_QUIT: {
-				quit = true;
-			} break;
-
-			case SDL_KEYDOWN: {
-				switch (event.key.keysym.sym) {
-					case SDLK_ESCAPE: {
-						quit = true;
-					} break;
-
-					case SDLK_x: {
-						keypad[0] = KEY_ON;
-					} break;
-
-					case SDLK_1: {
-						keypad[1] = KEY_ON;
-					} break;
-
-					case SDLK_2: {
-						keypad[2] = KEY_ON;
-					} break;
-
-					case SDLK_3: {
-						keypad[3] = KEY_ON;
-					} break;
-
-					case SDLK_q: {
-						keypad[4] = KEY_ON;
-					} break;
-
-					case SDLK_w: {
-						keypad[5] = KEY_ON;
-					} break;
-
-					case SDLK_e: {
-						keypad[6] = KEY_ON;
-					} break;
-
-					case SDLK_a: {
-						keypad[7] = KEY_ON;
-					} break;
-
-					case SDLK_s: {
-						keypad[8] = KEY_ON;
-					} break;
-
-					case SDLK_d: {
-						keypad[9] = KEY_ON;
-					} break;
-
-					case SDLK_z: {
-						keypad[0xA] = KEY_ON;
-					} break;
-
-					case SDLK_c: {
-						keypad[0xB] = KEY_ON;
-					} break;
-
-					case SDLK_4: {
-						keypad[0xC] = KEY_ON;
-					} break;
-
-					case SDLK_r: {
-						keypad[0xD] = KEY_ON;
-					} break;
-
-					case SDLK_f: {
-						keypad[0xE] = KEY_ON;
-					} break;
-
-					case SDLK_v: {
-					    keypad[0xF] = KEY_ON;
-					} break;
-				}
-			} break;
-
-			case SDL_KEYUP: {
-				switch (event.key.keysym.sym) {
-					case SDLK_x: {
-					    keypad[0] = KEY_OFF;
-					} break;
-
-					case SDLK_1: {
-						keypad[1] = KEY_OFF;
-					} break;
-
-					case SDLK_2: {
-						keypad[2] = KEY_OFF;
-					} break;
-
-					case SDLK_3: {
-						keypad[3] = KEY_OFF;
-					} break;
-
-					case SDLK_q: {
-						keypad[4] = KEY_OFF;
-					} break;
-
-					case SDLK_w: {
-						keypad[5] = KEY_OFF;
-					} break;
-
-					case SDLK_e: {
-						keypad[6] = KEY_OFF;
-					} break;
-
-					case SDLK_a: {
-						keypad[7] = KEY_OFF;
-					} break;
-
-					case SDLK_s: {
-						keypad[8] = KEY_OFF;
-					} break;
-
-					case SDLK_d: {
-						keypad[9] = KEY_OFF;
-					} break;
-
-					case SDLK_z: {
-						keypad[0xA] = KEY_OFF;
-					} break;
-
-					case SDLK_c: {
-						keypad[0xB] = KEY_OFF;
-					} break;
-
-					case SDLK_4: {
-						keypad[0xC] = KEY_OFF;
-					} break;
-
-					case SDLK_r: {
-						keypad[0xD] = KEY_OFF;
-					} break;
-
-					case SDLK_f: {
-						keypad[0xE] = KEY_OFF;
-					} break;
-
-					case SDLK_v: {
-					    keypad[0xF] = KEY_OFF;
-					} break;
-				}
-			} break;
-		}
-	}
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) {
+            quit = true;
+            continue;
+        }
+
+        if ((event.type != SDL_KEYDOWN && event.type != SDL_KEYUP) || event.key.repeat) {
+            continue;
+        }
+
+        bool pressed = event.type == SDL_KEYDOWN;
+        SDL_Keycode sym = event.key.keysym.sym;
+
+        if (sym == SDLK_ESCAPE) {
+            quit = quit || pressed;
+        } else if (sym == SDLK_BACKSPACE) {
+            rewindHeld = pressed;
+        } else {
+            const SDL_Keycode* match = std::find(KEYMAP, KEYMAP + 16, sym);
+            if (match != KEYMAP + 16) {
+                // SDL stamps events in milliseconds since it started
+                int64_t age = static_cast<int64_t>(SDL_GetTicks() - event.key.timestamp) * 1000000;
+                inputs.push_back({0, FrameScheduler::Now() - age, static_cast<uint8_t>(match - KEYMAP), pressed});
+            }
+        }
+    }
+
     return quit;
-}
\ No newline at end of file
+}
@@ -3,6 +3,11 @@
 
 #include <SDL2/SDL.h>
 
+#include <vector>
+
+#include "chip8.h"
+#include "input.h"
+
 const int DISPLAY_WIDTH = 64;
 const int DISPLAY_HEIGHT = 32;
 const int PIXEL_SCALE = 10; 
@@ -10,19 +15,35 @@ const int PIXEL_SCALE = 10;
 const int KEY_ON = 1;
 const int KEY_OFF = 0;
 
+const int INPUT_WAIT_TIMEOUT_MS = 100; // longest block waiting for input, so quitting stays responsive
+
 class Chip8_Video{
 public:
     Chip8_Video(int windowWidth, int windowHeight, int textureWidth, int textureHeight);
     ~Chip8_Video();
 
-    void Update(const void* buffer, int pitch);
-    void Render();
-    bool HandleInput(uint8_t* keypad);
+    void Update(const uint64_t (*video)[VIDEO_ROW_WORDS], int width, int height, uint64_t dirtyRows);
+    bool Render();
+    void RequestPresent() { presentPending = true; } // present again even if nothing changed
+    bool HandleInput(std::vector<KeyInput>& inputs);
+    bool WaitForInput(int timeoutMs);
+
+    int GetRefreshRate() const { return refreshRate; }
+    bool IsRewindHeld() const { return rewindHeld; } // backspace
+    bool IsPresentPending() const { return presentPending; }
 
 private:
     SDL_Window* window;
     SDL_Renderer* renderer;
     SDL_Texture* texture;
+    int textureWidth;
+    int textureHeight;
+    uint32_t pixels[HIRES_VIDEO_WIDTH * HIRES_VIDEO_HEIGHT]; // RGBA staging, textureWidth pixels per row
+    bool presentPending; // texture changed since the last present
+    uint64_t lastPresent; // performance counter at the last present
+    uint64_t presentInterval; // performance counter ticks per display refresh
+    int refreshRate; // Hz of the window's display
+    bool rewindHeld;
     bool running;
 };
 
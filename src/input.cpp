@@ -0,0 +1,37 @@
+#include "input.h"
+
+#include <algorithm>
+#include <cstdio>
+
+void InputLatency::Sent(const KeyInput& input) {
+    inFlight.push_back(input);
+}
+
+void InputLatency::Covered(uint64_t sequence) {
+    covered = std::max(covered, sequence);
+}
+
+/**
+ * Record the latency of every input the presented frames reflect.
+ */
+void InputLatency::Presented(int64_t time) {
+    while (!inFlight.empty() && inFlight.front().sequence <= covered) {
+        samples.push_back(time - inFlight.front().time);
+        inFlight.pop_front();
+    }
+
+    presented = covered;
+}
+
+void InputLatency::Print() const {
+    if (samples.empty()) {
+        return;
+    }
+
+    std::vector<int64_t> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    size_t count = sorted.size();
+    printf("Input to present: p50 %.1f ms, p99 %.1f ms, worst %.1f ms over %zu key events\n",
+           sorted[count / 2] / 1e6, sorted[std::min(count - 1, count * 99 / 100)] / 1e6, sorted.back() / 1e6, count);
+}
@@ -0,0 +1,46 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "spscring.h"
+
+const size_t INPUT_QUEUE_SIZE = 256;
+
+/**
+ * One keypad transition on its way from SDL to the core.
+ */
+struct KeyInput {
+    uint64_t sequence; // numbered from 1 in the order sent
+    int64_t time; // when the key moved, FrameScheduler::Now() clock
+    uint8_t key;
+    bool pressed;
+};
+
+// render thread to emulation thread
+typedef SpscRing<KeyInput, INPUT_QUEUE_SIZE> InputQueue;
+
+/**
+ * Input-to-present latency, tracked on the render thread.
+ * Every key transition sent is held until a presented frame reflects it,
+ * that is, a frame emulated after the transition was applied.
+ */
+class InputLatency {
+public:
+    void Sent(const KeyInput& input);
+    void Covered(uint64_t sequence); // an acquired frame reflects inputs up to sequence
+    bool IsPending() const { return covered > presented; }
+    void Presented(int64_t time); // the acquired frames were presented
+
+    void Print() const;
+
+private:
+    std::deque<KeyInput> inFlight; // sent, not yet presented
+    std::vector<int64_t> samples; // nanoseconds
+    uint64_t covered = 0;
+    uint64_t presented = 0;
+};
+
+#endif
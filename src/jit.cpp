@@ -0,0 +1,576 @@
+#include "jit.h"
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+// x86-64 register numbers used in ModRM fields
+const uint8_t EAX = 0;
+const uint8_t ECX = 1;
+const uint8_t EDX = 2;
+
+// condition codes for Jcc
+const uint8_t CC_E = 0x4;
+const uint8_t CC_NE = 0x5;
+const uint8_t CC_L = 0xC;
+
+/*
+ * Register use in generated code:
+ *   rbx = Chip8* (every field is addressed as [rbx + disp32])
+ *   r12 = remaining instruction budget
+ * Each block starts by checking the budget, so chained blocks never
+ * overrun it. pc is stored before every exit.
+ */
+
+Jit::Jit(Chip8& chip8) : chip8(chip8), arena(nullptr), cursor(nullptr), epilogue(nullptr), blocksStart(nullptr), enter(nullptr), writable(true), flushPending(false) {
+    const char* base = reinterpret_cast<const char*>(&chip8);
+    offV = reinterpret_cast<const char*>(&chip8.V[0]) - base;
+    offI = reinterpret_cast<const char*>(&chip8.I) - base;
+    offPC = reinterpret_cast<const char*>(&chip8.pc) - base;
+    offSP = reinterpret_cast<const char*>(&chip8.sp) - base;
+    offStack = reinterpret_cast<const char*>(&chip8.stack[0]) - base;
+
+#if defined(__x86_64__)
+    void* memory = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED) {
+        std::cerr << "WARNING: Unable to map JIT arena, using the interpreter" << std::endl;
+        return;
+    }
+
+    arena = static_cast<uint8_t*>(memory);
+    cursor = arena;
+
+    // entry trampoline: enter(chip8, budget, block)
+    enter = reinterpret_cast<EntryFunc>(cursor);
+    Emit8(0x53);                           // push rbx
+    Emit8(0x41); Emit8(0x54);              // push r12
+    Emit8(0x41); Emit8(0x55);              // push r13 (keeps rsp 16-byte aligned)
+    Emit8(0x48); Emit8(0x89); Emit8(0xFB); // mov rbx, rdi
+    Emit8(0x49); Emit8(0x89); Emit8(0xF4); // mov r12, rsi
+    Emit8(0xFF); Emit8(0xE2);              // jmp rdx
+
+    // shared epilogue, returns the remaining budget
+    epilogue = cursor;
+    Emit8(0x4C); Emit8(0x89); Emit8(0xE0); // mov rax, r12
+    Emit8(0x41); Emit8(0x5D);              // pop r13
+    Emit8(0x41); Emit8(0x5C);              // pop r12
+    Emit8(0x5B);                           // pop rbx
+    Emit8(0xC3);                           // ret
+
+    blocksStart = cursor;
+
+    // also finds out early if policy forbids executable anonymous memory
+    if (!Protect(false)) {
+        std::cerr << "WARNING: Unable to make the JIT arena executable, using the interpreter" << std::endl;
+        munmap(arena, JIT_ARENA_SIZE);
+        arena = nullptr;
+        return;
+    }
+#endif
+
+    Flush();
+}
+
+Jit::~Jit() {
+#if defined(__x86_64__)
+    if (arena != nullptr) {
+        munmap(arena, JIT_ARENA_SIZE);
+    }
+#endif
+}
+
+/**
+ * Check whether the JIT can run on this host.
+ */
+bool Jit::Available() {
+#if defined(__x86_64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * Execute up to the given number of instructions.
+ * Returns the number of instructions executed.
+ */
+uint32_t Jit::Run(uint32_t instructions) {
+    if (arena == nullptr) {
+        uint32_t executed = 0;
+        while (executed < instructions && !chip8.halted) {
+            chip8.Cycle();
+            executed++;
+        }
+        return executed;
+    }
+
+    int64_t remaining = instructions;
+
+    while (remaining > 0 && !chip8.halted) {
+        if (flushPending) {
+            Flush();
+        }
+
+        uint16_t address = chip8.pc;
+
+        // code running off the end of memory is left to the interpreter
+        if (address >= MEMORY_SIZE - 1) {
+            chip8.Cycle();
+            remaining--;
+            continue;
+        }
+
+        // a polling loop that would spin to the end of the budget
+        if (idleHeads[address]) {
+            remaining -= chip8.SkipIdle(remaining);
+            if (remaining == 0) {
+                break;
+            }
+        }
+
+        uint8_t* block = entries[address];
+        if (block == nullptr) {
+            block = Compile(address);
+        }
+
+        // not enough budget left for the whole block, or the arena
+        // couldn't be switched between writing and running
+        if (block == nullptr || counts[address] > remaining || !Protect(false)) {
+            chip8.Cycle();
+            remaining--;
+            continue;
+        }
+
+        remaining = enter(&chip8, remaining, block);
+    }
+
+    return instructions - remaining;
+}
+
+/**
+ * Called when memory is written. Compiled code is thrown away before the
+ * next block is entered if the write touched it. The writing instruction
+ * always ends its block, so no stale code runs in between.
+ */
+void Jit::Invalidate(unsigned int address, unsigned int length) {
+    for (unsigned int i = address; i < address + length && i < MEMORY_SIZE; i++) {
+        if (covered[i]) {
+            flushPending = true;
+            return;
+        }
+    }
+}
+
+/**
+ * Drop every compiled block.
+ */
+void Jit::Flush() {
+    cursor = blocksStart;
+
+    for (unsigned int i = 0; i < MEMORY_SIZE; i++) {
+        entries[i] = nullptr;
+        counts[i] = 0;
+        covered[i] = false;
+        idleHeads[i] = false;
+    }
+
+    instructions.clear();
+    pendingLinks.clear();
+    flushPending = false;
+}
+
+/**
+ * Check whether an instruction must end a basic block.
+ * Classified by resolved handler, since the tables ignore unused bits.
+ */
+bool Jit::EndsBlock(const Chip8::Instruction& instr) {
+    return instr.handler == &Chip8::OP_00EE
+        || instr.handler == &Chip8::OP_1nnn
+        || instr.handler == &Chip8::OP_2nnn
+        || instr.handler == &Chip8::OP_3xkk
+        || instr.handler == &Chip8::OP_4xkk
+        || instr.handler == &Chip8::OP_5xy0
+        || instr.handler == &Chip8::OP_9xy0
+        || instr.handler == &Chip8::OP_Bnnn
+        || instr.handler == &Chip8::OP_Ex9E
+        || instr.handler == &Chip8::OP_ExA1
+        || instr.handler == &Chip8::OP_Fx0A
+        || instr.handler == &Chip8::OP_Fx33
+        || instr.handler == &Chip8::OP_Fx55
+        || instr.handler == &Chip8::OP_00FD;
+}
+
+/**
+ * Translate the basic block starting at an address.
+ * Returns nullptr if the arena can't be made writable.
+ */
+uint8_t* Jit::Compile(uint16_t start) {
+    if (!Protect(true)) {
+        return nullptr;
+    }
+
+    if (cursor + JIT_MAX_BLOCK_BYTES > arena + JIT_ARENA_SIZE) {
+        Flush();
+    }
+
+    // find the extent of the block
+    std::vector<Chip8::Instruction> block;
+    uint16_t address = start;
+
+    while (block.size() < JIT_MAX_BLOCK_INSTRUCTIONS && address < MEMORY_SIZE - 1) {
+        Chip8::Instruction instr;
+        chip8.Decode((chip8.memory[address] << 8u) | chip8.memory[address + 1], instr);
+        block.push_back(instr);
+        address += 2;
+
+        if (EndsBlock(instr)) {
+            break;
+        }
+    }
+
+    uint8_t count = block.size();
+    uint8_t* entry = cursor;
+
+    // budget check
+    Emit8(0x49); Emit8(0x83); Emit8(0xFC); Emit8(count); // cmp r12, count
+    EmitJcc32(CC_L, epilogue);                           // jl epilogue
+    Emit8(0x49); Emit8(0x83); Emit8(0xEC); Emit8(count); // sub r12, count
+
+    address = start;
+
+    for (const Chip8::Instruction& instr : block) {
+        uint16_t next = address + 2;
+
+        if (!EndsBlock(instr)) {
+            if (!EmitNative(instr)) {
+                EmitCall(instr);
+            }
+
+            address = next;
+            continue;
+        }
+
+        switch (instr.opcode & 0xF000u) {
+            case 0x0000: { // RET
+                if (instr.handler == &Chip8::OP_00FD) { // EXIT
+                    EmitStorePC(next);
+                    EmitCall(instr);
+                    EmitDynamicExit();
+                    break;
+                }
+
+                EmitMem(0xFE, 1, offSP);                              // dec byte [sp]
+                EmitMem2(0xB6, EAX, offSP);                           // movzx eax, byte [sp]
+                Emit8(0x0F); Emit8(0xB7); Emit8(0x8C); Emit8(0x43);   // movzx ecx, word [rbx + rax*2 + stack]
+                Emit32(offStack);
+                Emit8(0x66); EmitMem(0x89, ECX, offPC);               // mov [pc], cx
+                EmitDynamicExit();
+            } break;
+
+            case 0x1000: { // JP addr
+                EmitExit(instr.nnn);
+            } break;
+
+            case 0x2000: { // CALL addr
+                EmitMem2(0xB6, EAX, offSP);                           // movzx eax, byte [sp]
+                Emit8(0x66); Emit8(0xC7); Emit8(0x84); Emit8(0x43);   // mov word [rbx + rax*2 + stack], next
+                Emit32(offStack);
+                Emit16(next);
+                EmitMem(0xFE, 0, offSP);                              // inc byte [sp]
+                EmitExit(instr.nnn);
+            } break;
+
+            case 0x3000:   // SE Vx, byte
+            case 0x4000: { // SNE Vx, byte
+                EmitMem(0x80, 7, offV + instr.x);                     // cmp byte [Vx], kk
+                Emit8(instr.kk);
+                uint8_t* notTaken = EmitJcc32((instr.opcode & 0xF000u) == 0x3000 ? CC_NE : CC_E, nullptr);
+                EmitExit(next + 2);
+                Patch32(notTaken, cursor);
+                EmitExit(next);
+            } break;
+
+            case 0x5000:   // SE Vx, Vy
+            case 0x9000: { // SNE Vx, Vy
+                EmitMem2(0xB6, EAX, offV + instr.x);                  // movzx eax, byte [Vx]
+                EmitMem(0x3A, EAX, offV + instr.y);                   // cmp al, [Vy]
+                uint8_t* notTaken = EmitJcc32((instr.opcode & 0xF000u) == 0x5000 ? CC_NE : CC_E, nullptr);
+                EmitExit(next + 2);
+                Patch32(notTaken, cursor);
+                EmitExit(next);
+            } break;
+
+            case 0xB000: { // JP V0, addr
+                EmitMem2(0xB6, EAX, offV);                            // movzx eax, byte [V0]
+                Emit8(0x05); Emit32(instr.nnn);                       // add eax, nnn
+                Emit8(0x66); EmitMem(0x89, EAX, offPC);               // mov [pc], ax
+                EmitDynamicExit();
+            } break;
+
+            default: { // SKP, SKNP, LD Vx K, LD B, LD [I]
+                EmitStorePC(next);
+                EmitCall(instr);
+                EmitDynamicExit();
+            } break;
+        }
+
+        address = next;
+    }
+
+    // block was cut short, fall through to the next address
+    if (!EndsBlock(block.back())) {
+        EmitExit(address);
+    }
+
+    entries[start] = entry;
+    counts[start] = count;
+    idleHeads[start] = chip8.IdleLoopLength(start) != 0;
+
+    for (unsigned int i = start; i < address && i < MEMORY_SIZE; i++) {
+        covered[i] = true;
+    }
+
+    // chain blocks that were waiting for this one, idle loops keep exiting to Run
+    auto waiting = pendingLinks.find(start);
+    if (waiting != pendingLinks.end()) {
+        if (!idleHeads[start]) {
+            for (uint8_t* site : waiting->second) {
+                Patch32(site, entry);
+            }
+        }
+        pendingLinks.erase(waiting);
+    }
+
+    return entry;
+}
+
+/**
+ * Emit inline code for simple register instructions.
+ * Each sequence mirrors the order of reads and writes in op.cpp,
+ * so VF aliasing behaves exactly like the interpreter.
+ */
+bool Jit::EmitNative(const Chip8::Instruction& instr) {
+    int32_t vx = offV + instr.x;
+    int32_t vy = offV + instr.y;
+    int32_t vf = offV + 0xF;
+
+    switch (instr.opcode & 0xF000u) {
+        case 0x6000: { // LD Vx, byte
+            EmitMem(0xC6, 0, vx); Emit8(instr.kk);
+        } return true;
+
+        case 0x7000: { // ADD Vx, byte
+            EmitMem(0x80, 0, vx); Emit8(instr.kk);
+        } return true;
+
+        case 0x8000: {
+            switch (instr.n) {
+                case 0x0: { // LD Vx, Vy
+                    EmitMem2(0xB6, EAX, vy);
+                    EmitMem(0x88, EAX, vx);
+                } return true;
+
+                case 0x1: { // OR Vx, Vy
+                    EmitMem2(0xB6, EAX, vy);
+                    EmitMem(0x08, EAX, vx);
+                } return true;
+
+                case 0x2: { // AND Vx, Vy
+                    EmitMem2(0xB6, EAX, vy);
+                    EmitMem(0x20, EAX, vx);
+                } return true;
+
+                case 0x3: { // XOR Vx, Vy
+                    EmitMem2(0xB6, EAX, vy);
+                    EmitMem(0x30, EAX, vx);
+                } return true;
+
+                case 0x4: { // ADD Vx, Vy
+                    EmitMem2(0xB6, EAX, vx);
+                    EmitMem2(0xB6, ECX, vy);
+                    Emit8(0x01); Emit8(0xC8);               // add eax, ecx
+                    Emit8(0x89); Emit8(0xC2);               // mov edx, eax
+                    Emit8(0xC1); Emit8(0xEA); Emit8(0x08);  // shr edx, 8
+                    EmitMem(0x88, EDX, vf);
+                    EmitMem(0x88, EAX, vx);
+                } return true;
+
+                case 0x5:   // SUB Vx, Vy
+                case 0x7: { // SUBN Vx, Vy
+                    int32_t a = instr.n == 0x5 ? vx : vy;
+                    int32_t b = instr.n == 0x5 ? vy : vx;
+                    EmitMem2(0xB6, EAX, a);
+                    EmitMem2(0xB6, ECX, b);
+                    Emit8(0x38); Emit8(0xC8);               // cmp al, cl
+                    Emit8(0x0F); Emit8(0x97); Emit8(0xC2);  // seta dl
+                    EmitMem(0x88, EDX, vf);
+                    EmitMem2(0xB6, EAX, a);
+                    EmitMem2(0xB6, ECX, b);
+                    Emit8(0x28); Emit8(0xC8);               // sub al, cl
+                    EmitMem(0x88, EAX, vx);
+                } return true;
+
+                case 0x6: { // SHR Vx
+                    EmitMem2(0xB6, EAX, vx);
+                    Emit8(0x83); Emit8(0xE0); Emit8(0x01);  // and eax, 1
+                    EmitMem(0x88, EAX, vf);
+                    EmitMem(0xD0, 5, vx);                   // shr byte [Vx], 1
+                } return true;
+
+                case 0xE: { // SHL Vx
+                    EmitMem2(0xB6, EAX, vx);
+                    Emit8(0xC1); Emit8(0xE8); Emit8(0x07);  // shr eax, 7
+                    EmitMem(0x88, EAX, vf);
+                    EmitMem(0xD0, 4, vx);                   // shl byte [Vx], 1
+                } return true;
+
+                default: return false;
+            }
+        }
+
+        case 0xA000: { // LD I, addr
+            Emit8(0x66); EmitMem(0xC7, 0, offI); Emit16(instr.nnn);
+        } return true;
+
+        case 0xF000: {
+            if (instr.kk == 0x1E) { // ADD I, Vx
+                EmitMem2(0xB6, EAX, vx);
+                Emit8(0x66); EmitMem(0x01, EAX, offI);
+                return true;
+            }
+        } return false;
+
+        default: return false;
+    }
+}
+
+/**
+ * Run an instruction through its interpreter handler.
+ */
+void Jit::Execute(Chip8* chip8, const Chip8::Instruction* instr) {
+    chip8->instr = instr;
+    chip8->opcode = instr->opcode;
+    ((*chip8).*(instr->handler))();
+}
+
+void Jit::Emit8(uint8_t b) {
+    *cursor++ = b;
+}
+
+void Jit::Emit16(uint16_t v) {
+    memcpy(cursor, &v, sizeof(v));
+    cursor += sizeof(v);
+}
+
+void Jit::Emit32(uint32_t v) {
+    memcpy(cursor, &v, sizeof(v));
+    cursor += sizeof(v);
+}
+
+void Jit::Emit64(uint64_t v) {
+    memcpy(cursor, &v, sizeof(v));
+    cursor += sizeof(v);
+}
+
+/**
+ * Emit an instruction with a [rbx + disp32] memory operand.
+ */
+void Jit::EmitMem(uint8_t opcode, uint8_t reg, int32_t disp) {
+    Emit8(opcode);
+    Emit8(0x83 | (reg << 3));
+    Emit32(disp);
+}
+
+/**
+ * Same as EmitMem for two-byte (0x0F) opcodes.
+ */
+void Jit::EmitMem2(uint8_t opcode, uint8_t reg, int32_t disp) {
+    Emit8(0x0F);
+    EmitMem(opcode, reg, disp);
+}
+
+void Jit::EmitStorePC(uint16_t address) {
+    Emit8(0x66); EmitMem(0xC7, 0, offPC); Emit16(address); // mov word [pc], address
+}
+
+/**
+ * Emit a call to Execute for an instruction.
+ */
+void Jit::EmitCall(const Chip8::Instruction& instr) {
+    instructions.push_back(instr);
+
+    Emit8(0x48); Emit8(0x89); Emit8(0xDF);                                        // mov rdi, rbx
+    Emit8(0x48); Emit8(0xBE); Emit64(reinterpret_cast<uint64_t>(&instructions.back())); // mov rsi, instr
+    Emit8(0x48); Emit8(0xB8); Emit64(reinterpret_cast<uint64_t>(&Jit::Execute));        // mov rax, Execute
+    Emit8(0xFF); Emit8(0xD0);                                                     // call rax
+}
+
+/**
+ * Leave the block for a known address, chaining to it when possible.
+ */
+void Jit::EmitExit(uint16_t target) {
+    EmitStorePC(target);
+
+    if (target >= MEMORY_SIZE - 1) {
+        EmitJump32(epilogue);
+    } else if (entries[target] != nullptr && !idleHeads[target]) {
+        EmitJump32(entries[target]);
+    } else {
+        pendingLinks[target].push_back(EmitJump32(epilogue));
+    }
+}
+
+/**
+ * Leave the block for the address already stored in pc.
+ */
+void Jit::EmitDynamicExit() {
+    EmitJump32(epilogue);
+}
+
+uint8_t* Jit::EmitJump32(const uint8_t* target) {
+    Emit8(0xE9);
+    uint8_t* site = cursor;
+    Emit32(0);
+    Patch32(site, target);
+    return site;
+}
+
+uint8_t* Jit::EmitJcc32(uint8_t condition, const uint8_t* target) {
+    Emit8(0x0F);
+    Emit8(0x80 | condition);
+    uint8_t* site = cursor;
+    Emit32(0);
+    if (target != nullptr) {
+        Patch32(site, target);
+    }
+    return site;
+}
+
+/**
+ * Switch the arena between writable, for compiling and patching, and
+ * executable, for running. It is never both at once. Switches only when
+ * needed, so compiling several blocks in a row costs one pair of calls.
+ */
+bool Jit::Protect(bool writable) {
+    if (this->writable == writable) {
+        return true;
+    }
+
+#if defined(__x86_64__)
+    if (mprotect(arena, JIT_ARENA_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+        return false;
+    }
+#endif
+
+    this->writable = writable;
+    return true;
+}
+
+/**
+ * Point a rel32 operand at a target.
+ */
+void Jit::Patch32(uint8_t* site, const uint8_t* target) {
+    int32_t rel = target - (site + 4);
+    memcpy(site, &rel, sizeof(rel));
+}
@@ -0,0 +1,88 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "chip8.h"
+
+const unsigned int JIT_ARENA_SIZE = 4 * 1024 * 1024; // bytes of executable memory
+const unsigned int JIT_MAX_BLOCK_INSTRUCTIONS = 64;
+const unsigned int JIT_MAX_BLOCK_BYTES = 8 * 1024; // worst case native size of one block
+
+/**
+ * x86-64 dynamic recompiler.
+ * Translates basic blocks into native code in an mmap'd arena. The arena
+ * is writable while blocks are compiled and executable while they run,
+ * never both. Blocks end at jumps, calls, returns, skips and anything
+ * that may rewrite pc or code.
+ * Register ops are emitted inline; everything else calls the interpreter
+ * handler for exact semantics. Direct exits are patched to jump straight
+ * into their target block once it is compiled, except into idle loops,
+ * which go back through Run so they can be fast-forwarded.
+ */
+class Jit {
+public:
+    Jit(Chip8& chip8);
+    ~Jit();
+
+    static bool Available();
+
+    uint32_t Run(uint32_t instructions);
+    void Invalidate(unsigned int address, unsigned int length);
+
+private:
+    typedef int64_t (*EntryFunc)(Chip8* chip8, int64_t budget, const uint8_t* block);
+
+    uint8_t* Compile(uint16_t address);
+    void Flush();
+
+    // emitters
+    void Emit8(uint8_t b);
+    void Emit16(uint16_t v);
+    void Emit32(uint32_t v);
+    void Emit64(uint64_t v);
+    void EmitMem(uint8_t opcode, uint8_t reg, int32_t disp);
+    void EmitMem2(uint8_t opcode, uint8_t reg, int32_t disp);
+    void EmitStorePC(uint16_t address);
+    void EmitCall(const Chip8::Instruction& instr);
+    void EmitExit(uint16_t target);
+    void EmitDynamicExit();
+    uint8_t* EmitJump32(const uint8_t* target);
+    uint8_t* EmitJcc32(uint8_t condition, const uint8_t* target);
+    void Patch32(uint8_t* site, const uint8_t* target);
+    bool Protect(bool writable);
+    bool EmitNative(const Chip8::Instruction& instr);
+
+    static bool EndsBlock(const Chip8::Instruction& instr);
+    static void Execute(Chip8* chip8, const Chip8::Instruction* instr);
+
+    Chip8& chip8;
+
+    uint8_t* arena;
+    uint8_t* cursor;
+    uint8_t* epilogue;
+    uint8_t* blocksStart; // first byte after the trampoline and epilogue
+    EntryFunc enter;
+    bool writable; // arena protection, writable or executable
+
+    uint8_t* entries[MEMORY_SIZE]; // compiled block per start address
+    uint8_t counts[MEMORY_SIZE]; // instructions in each block
+    bool covered[MEMORY_SIZE]; // byte is part of some compiled block
+    bool idleHeads[MEMORY_SIZE]; // block starts an idle loop, never chained into
+    bool flushPending;
+
+    std::deque<Chip8::Instruction> instructions; // stable copies for helper calls
+    std::unordered_map<uint16_t, std::vector<uint8_t*>> pendingLinks;
+
+    // field offsets from the Chip8 object
+    int32_t offV;
+    int32_t offI;
+    int32_t offPC;
+    int32_t offSP;
+    int32_t offStack;
+};
+
+#endif
@@ -0,0 +1,576 @@
+#include "lanes.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// vector code is built for AVX2 whatever the baseline, and only run after Available()
+#define LANES_AVX2 __attribute__((target("avx2")))
+#endif
+
+LaneGroup::LaneGroup() {
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        lanes[lane] = new Chip8();
+    }
+
+    memset(&regs, 0, sizeof(regs));
+    Reset();
+}
+
+LaneGroup::~LaneGroup() {
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        delete lanes[lane];
+    }
+}
+
+/**
+ * Check whether lanes can run in vectors on this host.
+ * Without AVX2 a LaneGroup still works, one lane at a time.
+ */
+bool LaneGroup::Available() {
+#if defined(__x86_64__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+/**
+ * Load a ROM into every lane.
+ */
+bool LaneGroup::LoadROM(const char* filename) {
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        if (!lanes[lane]->LoadROM(filename)) {
+            return false;
+        }
+    }
+
+    Reset();
+    return true;
+}
+
+/**
+ * Load a program image into every lane.
+ */
+bool LaneGroup::LoadProgram(const uint8_t* data, size_t size) {
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        if (!lanes[lane]->LoadProgram(data, size)) {
+            return false;
+        }
+    }
+
+    Reset();
+    return true;
+}
+
+/**
+ * Take the shared image and the registers from the lanes after a load.
+ */
+void LaneGroup::Reset() {
+    const Chip8& first = *lanes[0];
+
+    memcpy(image, first.memory, sizeof(image));
+    for (unsigned int address = 0; address < MEMORY_SIZE - 1; address++) {
+        first.Decode(image[address] << 8u | image[address + 1], decoded[address]);
+    }
+
+    for (unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        idleHeads[address] = first.IdleLoopLength(address) != 0;
+    }
+
+    memset(codeDiffers, 0, sizeof(codeDiffers));
+    halted = 0;
+
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        SyncFromLane(lane);
+        if (lanes[lane]->halted) {
+            halted |= 1u << lane;
+        }
+    }
+}
+
+void LaneGroup::SetSeed(unsigned int lane, uint64_t seed) {
+    lanes[lane]->SetSeed(seed);
+}
+
+Chip8& LaneGroup::GetLane(unsigned int lane) {
+    SyncToLane(lane);
+    return *lanes[lane];
+}
+
+/**
+ * Copy a lane's registers into its Chip8.
+ */
+void LaneGroup::SyncToLane(unsigned int lane) {
+    Chip8& chip8 = *lanes[lane];
+
+    for (unsigned int r = 0; r < 16; r++) {
+        chip8.V[r] = regs.V[r][lane];
+    }
+    chip8.I = regs.I[lane];
+    chip8.pc = regs.pc[lane];
+    chip8.sp = regs.sp[lane];
+    chip8.delayTimer = regs.delayTimer[lane];
+    chip8.soundTimer = regs.soundTimer[lane];
+}
+
+/**
+ * Copy a lane's registers back from its Chip8.
+ */
+void LaneGroup::SyncFromLane(unsigned int lane) {
+    const Chip8& chip8 = *lanes[lane];
+
+    for (unsigned int r = 0; r < 16; r++) {
+        regs.V[r][lane] = chip8.V[r];
+    }
+    regs.I[lane] = chip8.I;
+    regs.pc[lane] = chip8.pc;
+    regs.sp[lane] = chip8.sp;
+    regs.delayTimer[lane] = chip8.delayTimer;
+    regs.soundTimer[lane] = chip8.soundTimer;
+}
+
+/**
+ * Run one instruction of one lane through its own Chip8.
+ */
+void LaneGroup::StepLane(unsigned int lane) {
+    Chip8& chip8 = *lanes[lane];
+    SyncToLane(lane);
+
+    uint16_t address = chip8.I;
+    uint16_t opcode = chip8.pc < MEMORY_SIZE - 1 ? chip8.memory[chip8.pc] << 8u | chip8.memory[chip8.pc + 1] : 0;
+
+    chip8.Cycle();
+    SyncFromLane(lane);
+
+    // Fx33 and Fx55 are the only instructions that write memory
+    if ((opcode & 0xF0FFu) == 0xF033u) {
+        CompareCode(lane, address, 3);
+    } else if ((opcode & 0xF0FFu) == 0xF055u) {
+        CompareCode(lane, address, ((opcode & 0x0F00u) >> 8u) + 1);
+    }
+
+    if (chip8.halted) {
+        halted |= 1u << lane;
+    }
+}
+
+/**
+ * Fast-forward the lanes spinning in an idle loop at their pc.
+ * Returns the lanes whose budget that used up.
+ */
+LaneMask LaneGroup::SkipIdle(LaneMask group, uint32_t* remaining, uint64_t& executed) {
+    LaneMask spent = 0;
+
+    for (LaneMask pending = group; pending != 0; pending &= pending - 1) {
+        unsigned int lane = __builtin_ctz(pending);
+
+        SyncToLane(lane);
+        uint32_t skipped = lanes[lane]->SkipIdle(remaining[lane]);
+        SyncFromLane(lane);
+
+        remaining[lane] -= skipped;
+        executed += skipped;
+        if (remaining[lane] == 0) {
+            spent |= 1u << lane;
+        }
+    }
+
+    return spent;
+}
+
+/**
+ * Execute the instruction at address on every lane in group through its
+ * op.cpp handler, copying in and out only the registers the instruction
+ * uses, if it is one that needs per lane state: the RNG, keypad, stack,
+ * memory or display.
+ * Returns false, having done nothing, for anything else.
+ */
+bool LaneGroup::ExecuteLanes(const Chip8::Instruction& instr, uint16_t address, LaneMask group) {
+    uint8_t x = instr.x;
+    uint8_t y = instr.y;
+    uint16_t next = address + INSTRUCTION_WIDTH;
+
+    switch (instr.operation) {
+        case OPERATION_00E0:
+        case OPERATION_2nnn:
+        case OPERATION_00EE:
+        case OPERATION_Cxkk:
+        case OPERATION_Dxyn:
+        case OPERATION_Dxy0:
+        case OPERATION_Ex9E:
+        case OPERATION_ExA1:
+        case OPERATION_Fx33:
+        case OPERATION_Fx55:
+        case OPERATION_Fx65:
+            break;
+        default:
+            return false;
+    }
+
+    for (LaneMask pending = group; pending != 0; pending &= pending - 1) {
+        unsigned int lane = __builtin_ctz(pending);
+        Chip8& chip8 = *lanes[lane];
+
+        // in
+        chip8.pc = next;
+        chip8.sp = regs.sp[lane];
+        chip8.I = regs.I[lane];
+        chip8.V[x] = regs.V[x][lane];
+        chip8.V[y] = regs.V[y][lane];
+        if (instr.operation == OPERATION_Fx55) {
+            for (unsigned int r = 0; r <= x; r++) {
+                chip8.V[r] = regs.V[r][lane];
+            }
+        }
+
+        chip8.instr = &instr;
+        chip8.opcode = instr.opcode;
+        (chip8.*(instr.handler))();
+
+        // out
+        regs.pc[lane] = chip8.pc;
+        regs.sp[lane] = chip8.sp;
+        switch (instr.operation) {
+            case OPERATION_Cxkk:
+                regs.V[x][lane] = chip8.V[x];
+                break;
+            case OPERATION_Dxyn:
+            case OPERATION_Dxy0:
+                regs.V[0xF][lane] = chip8.V[0xF];
+                break;
+            case OPERATION_Fx33:
+                CompareCode(lane, chip8.I, 3);
+                break;
+            case OPERATION_Fx55:
+                CompareCode(lane, chip8.I, x + 1);
+                break;
+            case OPERATION_Fx65:
+                for (unsigned int r = 0; r <= x; r++) {
+                    regs.V[r][lane] = chip8.V[r];
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Note where a lane's memory now differs from the image, after a write.
+ */
+void LaneGroup::CompareCode(unsigned int lane, unsigned int address, unsigned int length) {
+    const uint8_t* memory = lanes[lane]->memory;
+
+    for (unsigned int i = address; i < address + length && i < MEMORY_SIZE; i++) {
+        if (memory[i] != image[i]) {
+            codeDiffers[i] |= 1u << lane;
+        } else {
+            codeDiffers[i] &= ~(1u << lane);
+        }
+    }
+}
+
+/**
+ * Execute up to the given number of instructions on every lane.
+ * Returns the number executed over all lanes.
+ */
+uint64_t LaneGroup::Run(uint32_t instructions) {
+#if defined(__x86_64__)
+    if (Available()) {
+        return RunVector(instructions);
+    }
+#endif
+
+    uint64_t executed = 0;
+
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        SyncToLane(lane);
+        executed += lanes[lane]->Run(instructions);
+        SyncFromLane(lane);
+    }
+
+    return executed;
+}
+
+/**
+ * Run one 60 Hz frame on every lane.
+ */
+uint64_t LaneGroup::RunFrame(uint32_t instructionsPerFrame) {
+    uint64_t executed = Run(instructionsPerFrame);
+
+    TickTimers();
+
+    return executed;
+}
+
+void LaneGroup::TickTimers() {
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        regs.delayTimer[lane] -= regs.delayTimer[lane] > 0;
+        regs.soundTimer[lane] -= regs.soundTimer[lane] > 0;
+    }
+}
+
+#if defined(__x86_64__)
+
+/* Lane masks as vectors: 32 lanes of bytes fill one register, 32 lanes
+    of words two, lanes 0-15 and 16-31. */
+
+static LANES_AVX2 inline __m256i ByteMask(LaneMask mask) {
+    const __m256i spread = _mm256_setr_epi64x(0x0000000000000000ll, 0x0101010101010101ll,
+                                              0x0202020202020202ll, 0x0303030303030303ll);
+    const __m256i bits = _mm256_set1_epi64x(static_cast<int64_t>(0x8040201008040201ull));
+
+    __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(mask), spread);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bits), bits);
+}
+
+static LANES_AVX2 inline __m256i WordMask(uint16_t mask) {
+    const __m256i bits = _mm256_setr_epi16(0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+                                           0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000,
+                                           static_cast<int16_t>(0x8000));
+
+    return _mm256_cmpeq_epi16(_mm256_and_si256(_mm256_set1_epi16(mask), bits), bits);
+}
+
+static LANES_AVX2 inline LaneMask WordLanes(__m256i low, __m256i high) {
+    // saturating packs keep 0 and -1, then undo the per 128-bit interleave
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8);
+    return _mm256_movemask_epi8(packed);
+}
+
+static LANES_AVX2 inline LaneMask ByteLanes(__m256i v) {
+    return _mm256_movemask_epi8(v);
+}
+
+static LANES_AVX2 inline __m256i LoadBytes(const uint8_t* lanes) {
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+}
+
+static LANES_AVX2 inline void StoreBytes(uint8_t* lanes, __m256i value, __m256i mask) {
+    __m256i* at = reinterpret_cast<__m256i*>(lanes);
+    _mm256_store_si256(at, _mm256_blendv_epi8(_mm256_load_si256(at), value, mask));
+}
+
+static LANES_AVX2 inline void StoreWords(uint16_t* lanes, __m256i low, __m256i high, LaneMask mask) {
+    __m256i* at = reinterpret_cast<__m256i*>(lanes);
+    _mm256_store_si256(at, _mm256_blendv_epi8(_mm256_load_si256(at), low, WordMask(mask)));
+    _mm256_store_si256(at + 1, _mm256_blendv_epi8(_mm256_load_si256(at + 1), high, WordMask(mask >> 16)));
+}
+
+// unsigned a > b, per byte
+static LANES_AVX2 inline __m256i GreaterThan(__m256i a, __m256i b) {
+    return _mm256_andnot_si256(_mm256_cmpeq_epi8(a, b), _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a));
+}
+
+/**
+ * Execute the instruction at address on every lane in group, if it is one
+ * that runs in vectors. The semantics are those of the op.cpp handlers,
+ * down to the order VF and Vx are written in.
+ * Returns false, having done nothing, for anything else.
+ */
+LANES_AVX2 bool LaneGroup::ExecuteVector(const Chip8::Instruction& instr, uint16_t address, LaneMask group) {
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i mask = ByteMask(group);
+
+    uint8_t* vx = regs.V[instr.x];
+    uint8_t* vy = regs.V[instr.y];
+    uint8_t* vf = regs.V[0xF];
+
+    uint16_t next = address + INSTRUCTION_WIDTH;
+    LaneMask skip = 0;
+
+    switch (instr.operation) {
+        case OPERATION_1nnn:
+            next = instr.nnn;
+            break;
+
+        case OPERATION_3xkk:
+            skip = ByteLanes(_mm256_cmpeq_epi8(LoadBytes(vx), _mm256_set1_epi8(instr.kk)));
+            break;
+        case OPERATION_4xkk:
+            skip = ~ByteLanes(_mm256_cmpeq_epi8(LoadBytes(vx), _mm256_set1_epi8(instr.kk)));
+            break;
+        case OPERATION_5xy0:
+            skip = ByteLanes(_mm256_cmpeq_epi8(LoadBytes(vx), LoadBytes(vy)));
+            break;
+        case OPERATION_9xy0:
+            skip = ~ByteLanes(_mm256_cmpeq_epi8(LoadBytes(vx), LoadBytes(vy)));
+            break;
+
+        case OPERATION_6xkk:
+            StoreBytes(vx, _mm256_set1_epi8(instr.kk), mask);
+            break;
+        case OPERATION_7xkk:
+            StoreBytes(vx, _mm256_add_epi8(LoadBytes(vx), _mm256_set1_epi8(instr.kk)), mask);
+            break;
+
+        case OPERATION_8xy0:
+            StoreBytes(vx, LoadBytes(vy), mask);
+            break;
+        case OPERATION_8xy1:
+            StoreBytes(vx, _mm256_or_si256(LoadBytes(vx), LoadBytes(vy)), mask);
+            break;
+        case OPERATION_8xy2:
+            StoreBytes(vx, _mm256_and_si256(LoadBytes(vx), LoadBytes(vy)), mask);
+            break;
+        case OPERATION_8xy3:
+            StoreBytes(vx, _mm256_xor_si256(LoadBytes(vx), LoadBytes(vy)), mask);
+            break;
+
+        case OPERATION_8xy4: {
+            __m256i x = LoadBytes(vx);
+            __m256i y = LoadBytes(vy);
+            __m256i sum = _mm256_add_epi8(x, y);
+            // a carry out of x + y is y > 255 - x
+            StoreBytes(vf, _mm256_and_si256(GreaterThan(y, _mm256_xor_si256(x, _mm256_set1_epi8(-1))), one), mask);
+            StoreBytes(vx, sum, mask);
+        } break;
+
+        case OPERATION_8xy5:
+            StoreBytes(vf, _mm256_and_si256(GreaterThan(LoadBytes(vx), LoadBytes(vy)), one), mask);
+            StoreBytes(vx, _mm256_sub_epi8(LoadBytes(vx), LoadBytes(vy)), mask);
+            break;
+
+        case OPERATION_8xy6:
+            StoreBytes(vf, _mm256_and_si256(LoadBytes(vx), one), mask);
+            StoreBytes(vx, _mm256_and_si256(_mm256_srli_epi16(LoadBytes(vx), 1), _mm256_set1_epi8(0x7F)), mask);
+            break;
+
+        case OPERATION_8xy7:
+            StoreBytes(vf, _mm256_and_si256(GreaterThan(LoadBytes(vy), LoadBytes(vx)), one), mask);
+            StoreBytes(vx, _mm256_sub_epi8(LoadBytes(vy), LoadBytes(vx)), mask);
+            break;
+
+        case OPERATION_8xyE:
+            StoreBytes(vf, _mm256_and_si256(_mm256_srli_epi16(LoadBytes(vx), 7), one), mask);
+            StoreBytes(vx, _mm256_add_epi8(LoadBytes(vx), LoadBytes(vx)), mask);
+            break;
+
+        case OPERATION_Annn: {
+            __m256i nnn = _mm256_set1_epi16(instr.nnn);
+            StoreWords(regs.I, nnn, nnn, group);
+        } break;
+
+        case OPERATION_Fx07:
+            StoreBytes(vx, LoadBytes(regs.delayTimer), mask);
+            break;
+        case OPERATION_Fx15:
+            StoreBytes(regs.delayTimer, LoadBytes(vx), mask);
+            break;
+        case OPERATION_Fx18:
+            StoreBytes(regs.soundTimer, LoadBytes(vx), mask);
+            break;
+
+        case OPERATION_Fx1E:
+        case OPERATION_Fx29:
+        case OPERATION_Fx30: {
+            __m256i x = LoadBytes(vx);
+            __m256i low = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x));
+            __m256i high = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x, 1));
+
+            if (instr.operation == OPERATION_Fx1E) {
+                const __m256i* I = reinterpret_cast<const __m256i*>(regs.I);
+                low = _mm256_add_epi16(_mm256_load_si256(I), low);
+                high = _mm256_add_epi16(_mm256_load_si256(I + 1), high);
+            } else {
+                bool big = instr.operation == OPERATION_Fx30;
+                __m256i base = _mm256_set1_epi16(big ? BIG_FONTSET_START_ADDRESS : FONTSET_START_ADDRESS);
+                __m256i size = _mm256_set1_epi16(big ? BIG_FONT_SIZE : FONT_SIZE);
+                __m256i digit = _mm256_set1_epi16(big ? 0x0F : 0xFF);
+
+                low = _mm256_add_epi16(base, _mm256_mullo_epi16(_mm256_and_si256(low, digit), size));
+                high = _mm256_add_epi16(base, _mm256_mullo_epi16(_mm256_and_si256(high, digit), size));
+            }
+
+            StoreWords(regs.I, low, high, group);
+        } break;
+
+        default:
+            return false;
+    }
+
+    skip &= group;
+    StoreWords(regs.pc, _mm256_set1_epi16(next), _mm256_set1_epi16(next), group & ~skip);
+    if (skip != 0) {
+        __m256i skipped = _mm256_set1_epi16(next + INSTRUCTION_WIDTH);
+        StoreWords(regs.pc, skipped, skipped, skip);
+    }
+
+    return true;
+}
+
+/**
+ * Run every lane for up to the given number of instructions, a group of
+ * lanes sharing a pc at a time.
+ */
+LANES_AVX2 uint64_t LaneGroup::RunVector(uint32_t instructions) {
+    alignas(32) uint32_t remaining[LANE_COUNT];
+    for (unsigned int lane = 0; lane < LANE_COUNT; lane++) {
+        remaining[lane] = instructions;
+    }
+
+    const __m256i* pcs = reinterpret_cast<const __m256i*>(regs.pc);
+    const __m256i lanesBits = _mm256_setr_epi32(1 << 0, 1 << 1, 1 << 2, 1 << 3, 1 << 4, 1 << 5, 1 << 6, 1 << 7);
+
+    LaneMask active = instructions > 0 ? ~halted : 0;
+    uint64_t executed = 0;
+
+    while (active != 0) {
+        // lowest pc among the lanes still running, lanes that are done read as 0xFFFF
+        __m256i low = _mm256_or_si256(_mm256_load_si256(pcs), _mm256_xor_si256(WordMask(active), _mm256_set1_epi8(-1)));
+        __m256i high = _mm256_or_si256(_mm256_load_si256(pcs + 1),
+                                       _mm256_xor_si256(WordMask(active >> 16), _mm256_set1_epi8(-1)));
+        __m256i lowest = _mm256_min_epu16(low, high);
+        __m128i folded = _mm_min_epu16(_mm256_castsi256_si128(lowest), _mm256_extracti128_si256(lowest, 1));
+        uint16_t address = _mm_cvtsi128_si32(_mm_minpos_epu16(folded));
+
+        __m256i target = _mm256_set1_epi16(address);
+        LaneMask group = WordLanes(_mm256_cmpeq_epi16(low, target), _mm256_cmpeq_epi16(high, target)) & active;
+
+        // lanes whose code here is not the image's go alone, as does code at the end of memory
+        LaneMask alone = address < MEMORY_SIZE - 1 ? group & (codeDiffers[address] | codeDiffers[address + 1]) : group;
+        group &= ~alone;
+
+        // a polling loop, fast-forwarded lane by lane like Chip8::Run does
+        if (group != 0 && idleHeads[address]) {
+            LaneMask spinning = group;
+            for (unsigned int i = 0; i < MAX_FUSED_LENGTH * INSTRUCTION_WIDTH; i++) {
+                spinning &= ~codeDiffers[address + i];
+            }
+
+            LaneMask spent = SkipIdle(spinning, remaining, executed);
+            group &= ~spent;
+            active &= ~spent;
+        }
+
+        if (group != 0 && !ExecuteVector(decoded[address], address, group)
+            && !ExecuteLanes(decoded[address], address, group)) {
+            alone |= group;
+        }
+
+        for (LaneMask lanes = alone; lanes != 0; lanes &= lanes - 1) {
+            StepLane(__builtin_ctz(lanes));
+        }
+
+        // one instruction off the budget of every lane that ran
+        LaneMask ran = group | alone;
+        LaneMask spent = 0;
+
+        for (unsigned int i = 0; i < LANE_COUNT; i += 8) {
+            __m256i* at = reinterpret_cast<__m256i*>(&remaining[i]);
+            __m256i bits = _mm256_and_si256(_mm256_set1_epi32(ran >> i), lanesBits);
+            __m256i left = _mm256_sub_epi32(_mm256_load_si256(at), _mm256_srli_epi32(_mm256_cmpeq_epi32(bits, lanesBits), 31));
+            _mm256_store_si256(at, left);
+            spent |= static_cast<LaneMask>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(left, _mm256_setzero_si256())))) << i;
+        }
+
+        executed += __builtin_popcount(ran);
+        active &= ~spent & ~halted;
+    }
+
+    return executed;
+}
+
+#endif
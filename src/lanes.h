@@ -0,0 +1,78 @@
+#ifndef LANES_H
+#define LANES_H
+
+#include <cstdint>
+
+#include "chip8.h"
+
+const unsigned int LANE_COUNT = 32; // instances in a LaneGroup, one byte of a 256-bit vector each
+
+typedef uint32_t LaneMask; // bit n is lane n
+
+/**
+ * Many instances of one ROM run side by side, for fuzzing and search
+ * where only the seed or the input differs between runs.
+ *
+ * V, I, pc, sp and the timers of every lane are kept in struct-of-arrays
+ * form. Each step picks the lowest pc among the lanes with budget left
+ * and executes that instruction for every lane sitting on it at once:
+ * register, timer, skip and jump ops with AVX2 under a lane mask, the
+ * rest lane by lane through each lane's own Chip8 and the op.cpp
+ * handlers, copying in and out only the registers they use. Lanes that
+ * part ways wait at their pc until the others fall behind or run out of
+ * budget, and regroup whenever their pcs meet.
+ *
+ * Each lane owns a complete Chip8 holding its memory, display, stack,
+ * keypad and RNG. Lanes whose code has been overwritten, so it no longer
+ * matches the ROM, run those addresses alone. Without AVX2 every lane
+ * simply runs on its own Chip8.
+ */
+class LaneGroup {
+public:
+    LaneGroup();
+    ~LaneGroup();
+
+    static bool Available();
+
+    bool LoadROM(const char* filename);
+    bool LoadProgram(const uint8_t* data, size_t size);
+    void SetSeed(unsigned int lane, uint64_t seed);
+
+    uint64_t Run(uint32_t instructions);
+    uint64_t RunFrame(uint32_t instructionsPerFrame);
+    void TickTimers();
+
+    // the lane's Chip8 with its registers up to date; set keys through its keypad
+    Chip8& GetLane(unsigned int lane);
+
+private:
+    struct Registers {
+        alignas(32) uint8_t V[16][LANE_COUNT];
+        alignas(32) uint16_t I[LANE_COUNT];
+        alignas(32) uint16_t pc[LANE_COUNT];
+        alignas(32) uint8_t sp[LANE_COUNT];
+        alignas(32) uint8_t delayTimer[LANE_COUNT];
+        alignas(32) uint8_t soundTimer[LANE_COUNT];
+    };
+
+    uint64_t RunVector(uint32_t instructions);
+    bool ExecuteVector(const Chip8::Instruction& instr, uint16_t address, LaneMask group);
+    bool ExecuteLanes(const Chip8::Instruction& instr, uint16_t address, LaneMask group);
+    void StepLane(unsigned int lane);
+    LaneMask SkipIdle(LaneMask group, uint32_t* remaining, uint64_t& executed);
+    void SyncToLane(unsigned int lane);
+    void SyncFromLane(unsigned int lane);
+    void CompareCode(unsigned int lane, unsigned int address, unsigned int length);
+    void Reset();
+
+    Registers regs;
+    Chip8* lanes[LANE_COUNT];
+
+    uint8_t image[MEMORY_SIZE]; // memory every lane started with
+    Chip8::Instruction decoded[MEMORY_SIZE - 1]; // the image, decoded at every address
+    bool idleHeads[MEMORY_SIZE]; // an idle loop in the image starts here
+    LaneMask codeDiffers[MEMORY_SIZE]; // per byte, lanes whose memory no longer matches the image
+    LaneMask halted;
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include "chip8.h"
+#include "recording.h"
+#include "../disassemble/disassembler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <string>
+#include <vector>
+
+/*
+ * Lockstep differential testing.
+ *
+ * Runs a ROM on two instances with the same seed and input: a reference
+ * that steps the op.cpp handlers one instruction at a time with fusion
+ * off, and a candidate on the engine under test (by default the fused,
+ * idle-skipping interpreter). After every frame the two states are
+ * hashed and compared, which is cheap enough for millions of
+ * instructions. On a mismatch both are rewound to the start of the
+ * frame and the frame is bisected down to the first instruction after
+ * which they differ; the differing fields and the instructions leading
+ * up to it are printed.
+ */
+
+struct LockstepOptions {
+    Engine engine;
+    bool fusion;
+    uint64_t seed;
+    uint32_t instructionsPerFrame;
+    uint32_t frames;
+    unsigned int context; // instructions shown before a divergence
+};
+
+/**
+ * Print the fields that differ between two snapshots.
+ */
+static void ReportDifferences(const Chip8State& reference, const Chip8State& candidate) {
+    for (unsigned int r = 0; r < 16; r++) {
+        if (reference.V[r] != candidate.V[r]) {
+            printf("  V%X:          %02x != %02x\n", r, reference.V[r], candidate.V[r]);
+        }
+    }
+
+    if (reference.I != candidate.I) {
+        printf("  I:           %03x != %03x\n", reference.I, candidate.I);
+    }
+    if (reference.pc != candidate.pc) {
+        printf("  pc:          %03x != %03x\n", reference.pc, candidate.pc);
+    }
+    if (reference.sp != candidate.sp) {
+        printf("  sp:          %d != %d\n", reference.sp, candidate.sp);
+    }
+    for (unsigned int i = 0; i < 16; i++) {
+        if (reference.stack[i] != candidate.stack[i]) {
+            printf("  stack[%u]:%s   %03x != %03x\n", i, i < 10 ? " " : "", reference.stack[i], candidate.stack[i]);
+        }
+    }
+    if (reference.delayTimer != candidate.delayTimer) {
+        printf("  delay timer: %d != %d\n", reference.delayTimer, candidate.delayTimer);
+    }
+    if (reference.soundTimer != candidate.soundTimer) {
+        printf("  sound timer: %d != %d\n", reference.soundTimer, candidate.soundTimer);
+    }
+    if (memcmp(reference.rplFlags, candidate.rplFlags, sizeof(reference.rplFlags)) != 0) {
+        printf("  RPL flags differ\n");
+    }
+    if (reference.rngState != candidate.rngState) {
+        printf("  RNG state:   %016" PRIx64 " != %016" PRIx64 "\n", reference.rngState, candidate.rngState);
+    }
+    if (reference.highRes != candidate.highRes || reference.halted != candidate.halted
+        || reference.waitingForKey != candidate.waitingForKey || reference.keyWait != candidate.keyWait) {
+        printf("  mode:        hires %d/%d, halted %d/%d, waiting %d/%d, key %02x/%02x\n", reference.highRes,
+               candidate.highRes, reference.halted, candidate.halted, reference.waitingForKey,
+               candidate.waitingForKey, reference.keyWait, candidate.keyWait);
+    }
+
+    // memory as runs of differing bytes
+    for (unsigned int i = 0; i < MEMORY_SIZE; i++) {
+        if (reference.memory[i] != candidate.memory[i]) {
+            unsigned int end = i;
+            while (end < MEMORY_SIZE && reference.memory[end] != candidate.memory[end]) {
+                end++;
+            }
+            printf("  memory:      %03x-%03x differs (%u bytes)\n", i, end - 1, end - i);
+            i = end;
+        }
+    }
+
+    unsigned int rows = 0;
+    for (unsigned int y = 0; y < HIRES_VIDEO_HEIGHT; y++) {
+        rows += memcmp(reference.video[y], candidate.video[y], sizeof(reference.video[y])) != 0;
+    }
+    if (rows > 0) {
+        printf("  video:       %u rows differ\n", rows);
+    }
+}
+
+/**
+ * Run the reference up to an instruction, printing the last few it
+ * executed and the one that follows, where the engines part ways.
+ */
+static void ReportContext(Chip8& reference, uint32_t instructions, unsigned int context) {
+    std::vector<std::pair<uint16_t, uint16_t>> window; // pc, opcode
+    Chip8State state;
+
+    auto fetch = [&state]() {
+        uint16_t pc = state.pc & (MEMORY_SIZE - 1);
+        return std::make_pair(state.pc, static_cast<uint16_t>(state.memory[pc] << 8 | state.memory[(pc + 1) & (MEMORY_SIZE - 1)]));
+    };
+
+    for (uint32_t i = 0; i < instructions && !reference.IsHalted(); i++) {
+        if (i + context >= instructions) {
+            reference.SaveState(state);
+            window.push_back(fetch());
+        }
+        reference.Cycle();
+    }
+
+    reference.SaveState(state);
+    window.push_back(fetch());
+
+    char line[DISASSEMBLY_LINE_MAX];
+    for (size_t i = 0; i < window.size(); i++) {
+        size_t length = Disassembler::formatLine(window[i].first, window[i].second, line);
+        printf("  %s %.*s", i + 1 == window.size() ? ">" : " ", static_cast<int>(length), line);
+    }
+}
+
+/**
+ * Run one frame on the reference, one instruction at a time.
+ */
+static uint32_t StepReference(Chip8& reference, uint32_t instructions) {
+    uint32_t executed = 0;
+
+    while (executed < instructions && !reference.IsHalted()) {
+        reference.Cycle();
+        executed++;
+    }
+
+    return executed;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <ROM> [options]\n"
+                  << "Options:\n"
+                  << "  --recording=<file> input, seed and speed from a recording made with --record\n"
+                  << "  --frames=<n>       frames to run without a recording (default: 3600)\n"
+                  << "  --ipf=<n>          instructions per frame (default: " << DEFAULT_INSTRUCTIONS_PER_FRAME << ")\n"
+                  << "  --seed=<n>         RNG seed (default: 0)\n"
+                  << "  --jit              check the x86-64 recompiler\n"
+                  << "  --aot              check the translation from chip8-aot, if linked in\n"
+                  << "  --nofusion         check the interpreter without superinstructions\n"
+                  << "  --context=<n>      instructions shown before a divergence (default: 16)\n";
+        return -1;
+    }
+
+    LockstepOptions options = {ENGINE_INTERPRETER, true, 0, DEFAULT_INSTRUCTIONS_PER_FRAME, 3600, 16};
+    std::string recordingFilename;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--recording=", 0) == 0) {
+            recordingFilename = arg.substr(12);
+        } else if (arg.rfind("--frames=", 0) == 0) {
+            options.frames = std::stoul(arg.substr(9));
+        } else if (arg.rfind("--ipf=", 0) == 0) {
+            options.instructionsPerFrame = std::stoul(arg.substr(6));
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            options.seed = std::stoull(arg.substr(7));
+        } else if (arg == "--jit") {
+            options.engine = ENGINE_JIT;
+        } else if (arg == "--aot") {
+            options.engine = ENGINE_AOT;
+        } else if (arg == "--nofusion") {
+            options.fusion = false;
+        } else if (arg.rfind("--context=", 0) == 0) {
+            options.context = std::stoul(arg.substr(10));
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+
+    Recording recording;
+    bool recorded = !recordingFilename.empty();
+
+    if (recorded) {
+        if (!recording.Load(recordingFilename.c_str())) {
+            return -1;
+        }
+        if (!recording.MatchesROM(argv[1])) {
+            std::cerr << "ERROR: " << argv[1] << " is not the ROM this was recorded with" << std::endl;
+            return -1;
+        }
+        options.seed = recording.GetSeed();
+        options.instructionsPerFrame = recording.GetInstructionsPerFrame();
+        options.frames = recording.GetFrames();
+    }
+
+    Chip8 reference;
+    Chip8 candidate;
+
+    reference.SetSeed(options.seed);
+    candidate.SetSeed(options.seed);
+    reference.SetFusion(false);
+    candidate.SetFusion(options.fusion);
+
+    if (!reference.LoadROM(argv[1]) || !candidate.LoadROM(argv[1])) {
+        return -1;
+    }
+
+    if (!candidate.SetEngine(options.engine)) {
+        std::cerr << (options.engine == ENGINE_AOT ? "ERROR: No chip8-aot translation of this ROM linked in\n"
+                                                   : "ERROR: JIT not available on this host\n");
+        return -1;
+    }
+
+    // state at the start of the current frame, to rewind to, and at its end
+    Chip8State referenceStart, candidateStart;
+    Chip8State referenceEnd, candidateEnd;
+
+    uint64_t instructions = 0;
+    uint64_t rollingHash = 0;
+    uint32_t frame = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (frame < options.frames && !reference.IsHalted()) {
+        if (recorded) {
+            uint16_t keys = recording.GetKeys(frame);
+            for (unsigned int key = 0; key < 16; key++) {
+                reference.keypad[key] = (keys >> key) & 1u;
+                candidate.keypad[key] = (keys >> key) & 1u;
+            }
+        }
+
+        reference.SaveState(referenceStart);
+        candidate.SaveState(candidateStart);
+
+        uint32_t executed = StepReference(reference, options.instructionsPerFrame);
+        uint32_t candidateExecuted = candidate.Run(options.instructionsPerFrame);
+
+        uint64_t hash = reference.GetStateHash();
+
+        if (executed != candidateExecuted || hash != candidate.GetStateHash()) {
+            /* bisect the frame: after lo instructions the two still agree,
+                after hi they don't */
+            uint32_t lo = 0;
+            uint32_t hi = std::max(executed, candidateExecuted);
+
+            while (hi - lo > 1) {
+                uint32_t mid = lo + (hi - lo) / 2;
+
+                reference.LoadState(referenceStart);
+                candidate.LoadState(candidateStart);
+
+                bool agree = StepReference(reference, mid) == candidate.Run(mid);
+
+                if (agree && reference.GetStateHash() == candidate.GetStateHash()) {
+                    lo = mid;
+                } else {
+                    hi = mid;
+                }
+            }
+
+            reference.LoadState(referenceStart);
+            candidate.LoadState(candidateStart);
+            uint32_t referenceSteps = StepReference(reference, hi);
+            uint32_t candidateSteps = candidate.Run(hi);
+            reference.SaveState(referenceEnd);
+            candidate.SaveState(candidateEnd);
+
+            printf("DIVERGED at instruction %" PRIu64 " (frame %u, instruction %u of it)\n", instructions + hi, frame, hi);
+            if (referenceSteps != candidateSteps) {
+                printf("  executed:    %u != %u\n", referenceSteps, candidateSteps);
+            }
+            ReportDifferences(referenceEnd, candidateEnd);
+
+            printf("reference leading up to it:\n");
+            reference.LoadState(referenceStart);
+            ReportContext(reference, hi - 1, options.context);
+
+            return 1;
+        }
+
+        instructions += executed;
+        rollingHash = (rollingHash ^ hash) * 0x100000001b3ull;
+
+        reference.TickTimers();
+        candidate.TickTimers();
+        frame++;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("frames:       %u of %u%s\n", frame, options.frames, reference.IsHalted() ? " (halted)" : "");
+    printf("instructions: %" PRIu64 "\n", instructions);
+    printf("time:         %.1f ms (%.1f MIPS, both engines)\n", ms, ms > 0 ? instructions / (ms * 1000.0) : 0.0);
+    printf("rolling hash: %016" PRIx64 "\n", rollingHash);
+    printf("no divergence\n");
+
+    return 0;
+}
@@ -1,7 +1,200 @@
 #include "chip8.h"
+#include "chip8audio.h"
 #include "chip8video.h"
+#include "input.h"
+#include "recording.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include "stateexport.h"
+#include "triplebuffer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+
+/**
+ * State shared between the render thread and the emulation thread.
+ */
+struct Controls {
+    InputQueue inputs; // key transitions not yet applied, oldest first
+    std::atomic<bool> rewind{false}; // step back one frame per frame while set
+    std::atomic<bool> running{true};
+    std::atomic<bool> waiting{false}; // emulation is blocked until the controls change
+
+    // signalled whenever the controls above change
+    std::mutex lock;
+    std::condition_variable changed;
+
+    /**
+     * Queue key transitions and update the rewind key, waking the
+     * emulation thread if anything changed. Returns false if the queue
+     * overflowed and transitions were lost.
+     */
+    bool Set(const std::vector<KeyInput>& transitions, bool rewinding) {
+        bool queued = true;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (transitions.empty() && rewind == rewinding) {
+                return true;
+            }
+            for (const KeyInput& input : transitions) {
+                queued = inputs.Push(input) && queued;
+            }
+            rewind = rewinding;
+        }
+        changed.notify_one();
+        return queued;
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running = false;
+        }
+        changed.notify_one();
+    }
+};
+
+/**
+ * Apply queued key transitions to pressed, at the start of a frame.
+ * A key moves at most once per frame: a second transition of the same key
+ * is held back to the next frame, with everything queued after it, so a
+ * tap shorter than a frame is still seen pressed. Returns the sequence of
+ * the last transition applied, or applied if there was none.
+ */
+static uint64_t ApplyInputs(Controls& controls, uint16_t& pressed, KeyInput& held, bool& holding, uint64_t applied) {
+    uint16_t moved = 0;
+    KeyInput input;
+
+    while (holding || controls.inputs.Pop(input)) {
+        if (holding) {
+            input = held;
+            holding = false;
+        }
+
+        uint16_t bit = 1u << input.key;
+        if (moved & bit) {
+            held = input;
+            holding = true;
+            break;
+        }
+
+        pressed = input.pressed ? pressed | bit : pressed & ~bit;
+        moved |= bit;
+        applied = input.sequence;
+    }
+
+    return applied;
+}
+
+/**
+ * Emulation thread: run 60 Hz frames and publish the display whenever it
+ * changed, or new input went into it. Key transitions are applied between
+ * frames, before a frame's first instruction.
+ * The state every frame starts from is recorded in the rewind history, if
+ * there is one, and its input in the recording, if there is one, and the
+ * machine state is exported to shared memory, if it is. The buzzer state
+ * of every frame goes to the audio output. While the ROM waits for a key with nothing
+ * else going on, it blocks instead.
+ */
+static void EmulationLoop(Chip8& chip8, unsigned int instructionsPerFrame, RewindBuffer* history,
+                          Recording* recording, StateExport* exported, Chip8_Audio& audio, TripleBuffer& frames,
+                          Controls& controls) {
+    FrameScheduler scheduler(FRAMES_PER_SECOND);
+    Chip8State state;
+
+    uint64_t publishedGeneration = ~0ull; // forces the first publish
+    uint64_t sequence = 0;
+    uint32_t frameCount = 0;
+
+    uint16_t pressed = 0; // bit k set while key k is down
+    uint64_t applied = 0; // last key transition applied
+    uint64_t publishedInput = 0;
+    KeyInput held;
+    bool holding = false;
+
+    while (controls.running.load(std::memory_order_relaxed)) {
+        applied = ApplyInputs(controls, pressed, held, holding, applied);
+
+        if (history != nullptr && controls.rewind.load(std::memory_order_relaxed)) {
+            // nothing left to rewind, hold the oldest frame
+            if (history->Pop(state)) {
+                chip8.LoadState(state);
+            }
+
+            audio.Publish(false);
+        } else {
+            for (unsigned int key = 0; key < 16; key++) {
+                chip8.keypad[key] = (pressed >> key) & 1u ? KEY_ON : KEY_OFF;
+            }
+
+            if (recording != nullptr) {
+                recording->Record(frameCount, pressed);
+            }
+
+            // the state the frame starts from, so the first pop steps back a whole frame
+            if (history != nullptr) {
+                chip8.SaveState(state);
+                history->Push(state);
+            }
+
+            // RunFrame, with the buzzer sampled before the timer tick so a sound timer of 1 is heard
+            chip8.Run(instructionsPerFrame);
+            audio.Publish(chip8.GetSoundTimer() > 0);
+            chip8.TickTimers();
+            frameCount++;
+        }
+
+        if (chip8.GetFrameGeneration() != publishedGeneration || applied != publishedInput) {
+            publishedGeneration = chip8.GetFrameGeneration();
+            publishedInput = applied;
+
+            Frame& frame = frames.GetBack();
+            memcpy(frame.video, chip8.video, sizeof(frame.video));
+            frame.width = chip8.GetVideoWidth();
+            frame.height = chip8.GetVideoHeight();
+            frame.dirtyRows = chip8.TakeDirtyRows();
+            frame.sequence = ++sequence;
+            frame.inputSequence = applied;
+            frames.Publish();
+        }
+
+        if (exported != nullptr) {
+            exported->Publish(chip8, frameCount);
+        }
+
+        if (chip8.IsHalted()) {
+            controls.running = false;
+        }
+
+        /* stopped at Fx0A with both timers run down, further frames would
+            change nothing until a key does, so sleep until then */
+        if (chip8.IsWaitingForKey() && chip8.GetDelayTimer() == 0 && chip8.GetSoundTimer() == 0
+            && !holding && !controls.rewind.load(std::memory_order_relaxed)) {
+            std::unique_lock<std::mutex> lock(controls.lock);
+            controls.waiting = true;
+            controls.changed.wait(lock, [&] {
+                return controls.inputs.Size() > 0 || controls.rewind || !controls.running;
+            });
+            controls.waiting = false;
+            lock.unlock();
+
+            scheduler.Reset();
+            continue;
+        }
+
+        // sleep until the next 60 Hz frame
+        scheduler.Wait();
+    }
+
+    if (recording != nullptr) {
+        recording->End(frameCount);
+    }
+}
 
 int main(int argc, char* argv[]) {
     // print signs of life
@@ -9,44 +202,179 @@ int main(int argc, char* argv[]) {
     printf(" Chip8 Emulator\n");
     printf("||||||||||||||||\n\n");
 
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
+    if (argc < 4) {
+        std::cerr << "Usage: " << argv[0] << " <Scale> <Speed> <ROM> [options]\n"
+                  << "  <Speed>           instructions per 60 Hz frame (default game speed is " << DEFAULT_INSTRUCTIONS_PER_FRAME << ")\n"
+                  << "Options:\n"
+                  << "  --trace=<level>   0 = off, 1 = instructions, 2 = instructions and registers\n"
+                  << "  --jit             run on the x86-64 recompiler instead of the interpreter\n"
+                  << "  --aot             run the ROM's chip8-aot translation, if it was linked in\n"
+                  << "  --rewind=<secs>   seconds of history kept for rewinding with Backspace (default: "
+                  << DEFAULT_REWIND_SECONDS << ", 0 = off)\n"
+                  << "  --record=<file>   record the session's input for emulator-replay (turns off rewind)\n"
+                  << "  --seed=<n>        RNG seed (default: from the clock)\n"
+                  << "  --shm=<name>      publish the machine state every frame to /dev/shm/<name>\n"
+                  << "  --audio=<n>       audio buffer in samples (default: " << DEFAULT_AUDIO_BUFFER << ", 0 = no sound)\n";
         return -1;
     }
 
     // cmd args
     int videoScale = std::stoi(argv[1]);
-    int cycleDelay = std::stoi(argv[2]);
+    int instructionsPerFrame = std::stoi(argv[2]);
     char const* ROMfilename = argv[3];
 
+    // optional args
+    int traceLevel = TRACE_OFF;
+    Engine engine = ENGINE_INTERPRETER;
+    unsigned int rewindSeconds = DEFAULT_REWIND_SECONDS;
+    std::string recordFilename;
+    std::string shmName;
+    int audioBuffer = DEFAULT_AUDIO_BUFFER;
+    uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+
+    for (int i = 4; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--trace=", 0) == 0) {
+            traceLevel = std::stoi(arg.substr(8));
+        } else if (arg == "--jit") {
+            engine = ENGINE_JIT;
+        } else if (arg == "--aot") {
+            engine = ENGINE_AOT;
+        } else if (arg.rfind("--rewind=", 0) == 0) {
+            rewindSeconds = std::stoi(arg.substr(9));
+        } else if (arg.rfind("--record=", 0) == 0) {
+            recordFilename = arg.substr(9);
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            seed = std::stoull(arg.substr(7));
+        } else if (arg.rfind("--shm=", 0) == 0) {
+            shmName = arg.substr(6);
+        } else if (arg.rfind("--audio=", 0) == 0) {
+            audioBuffer = std::stoi(arg.substr(8));
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+
     Chip8_Video chip8video(VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT);
+    Chip8_Audio chip8audio(audioBuffer);
+
+    // only when asked for, its drain thread wakes every millisecond
+    std::unique_ptr<Trace> trace;
+    if (traceLevel > TRACE_OFF) {
+        trace.reset(new Trace());
+        trace->SetLevel(static_cast<TraceLevel>(traceLevel));
+    }
 
     Chip8 chip8;
-    chip8.LoadROM(ROMfilename);
+    chip8.SetTrace(trace.get());
+    chip8.SetSeed(seed);
+    if (!chip8.LoadROM(ROMfilename)) {
+        return -1;
+    }
+
+    if (!chip8.SetEngine(engine)) {
+        std::cerr << (engine == ENGINE_AOT ? "WARNING: No chip8-aot translation of this ROM linked in, using the interpreter\n"
+                                           : "WARNING: JIT not available on this host, using the interpreter\n");
+    }
 
     chip8.MemoryDump();
 
     //return 0;
 
-    int videoPitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
+    std::unique_ptr<Recording> recording;
+    if (!recordFilename.empty()) {
+        recording.reset(new Recording());
+        if (!recording->Begin(seed, instructionsPerFrame, ROMfilename)) {
+            return -1;
+        }
 
-    auto lastCycleTime = std::chrono::high_resolution_clock::now();
+        // a rewound session can't be replayed from its input alone
+        if (rewindSeconds > 0) {
+            std::cerr << "NOTE: rewind is off while recording\n";
+            rewindSeconds = 0;
+        }
+    }
 
-    bool quit = false;
+    std::unique_ptr<RewindBuffer> history;
+    if (rewindSeconds > 0) {
+        history.reset(new RewindBuffer(rewindSeconds * FRAMES_PER_SECOND));
+    }
 
-    while (!quit) {
-        quit = chip8video.HandleInput(chip8.keypad);
+    std::unique_ptr<StateExport> exported;
+    if (!shmName.empty()) {
+        exported.reset(new StateExport());
+        if (!exported->Create(shmName.c_str())) {
+            return -1;
+        }
+    }
+
+    TripleBuffer frames;
+    Controls controls;
+
+    std::thread emulator(EmulationLoop, std::ref(chip8), instructionsPerFrame, history.get(), recording.get(),
+                         exported.get(), std::ref(chip8audio), std::ref(frames), std::ref(controls));
+
+    // SDL input and rendering stay on the main thread
+    FrameScheduler refresh(chip8video.GetRefreshRate());
+    uint64_t lastSequence = 0;
+
+    std::vector<KeyInput> transitions;
+    uint64_t inputSequence = 0;
+    InputLatency latency;
+
+    while (controls.running.load(std::memory_order_relaxed)) {
+        transitions.clear();
+        if (chip8video.HandleInput(transitions)) {
+            controls.Stop();
+        }
+
+        for (KeyInput& input : transitions) {
+            input.sequence = ++inputSequence;
+            latency.Sent(input);
+        }
+        if (!controls.Set(transitions, chip8video.IsRewindHeld())) {
+            std::cerr << "WARNING: Input queue full, key transitions lost\n";
+        }
+
+        // take the newest frame, if any. a skipped frame's dirty rows are lost, so redraw everything
+        if (frames.Acquire()) {
+            const Frame& frame = frames.GetFront();
+            uint64_t dirtyRows = frame.sequence == lastSequence + 1 ? frame.dirtyRows : ALL_ROWS;
+            lastSequence = frame.sequence;
+
+            chip8video.Update(frame.video, frame.width, frame.height, dirtyRows);
 
-        auto currentTime = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
+            // frames reflecting new input are presented even if they look the same, to time them
+            latency.Covered(frame.inputSequence);
+            if (latency.IsPending()) {
+                chip8video.RequestPresent();
+            }
+        }
+        if (chip8video.Render()) {
+            latency.Presented(FrameScheduler::Now());
+        }
 
-        if (dt > cycleDelay) {
-            lastCycleTime = currentTime;
-            chip8.Cycle();
-            chip8video.Update(chip8.video, videoPitch);
+        // nothing to show until input arrives, so block on it instead of polling
+        if (controls.waiting.load(std::memory_order_relaxed) && !chip8video.IsPresentPending()) {
+            chip8video.WaitForInput(INPUT_WAIT_TIMEOUT_MS);
+            refresh.Reset();
+        } else {
+            refresh.Wait();
         }
     }
 
+    emulator.join();
+
+    chip8audio.PrintStats();
+    latency.Print();
+
+    if (recording != nullptr && recording->Save(recordFilename.c_str())) {
+        printf("Recorded %u frames, %zu key events to %s (seed %llu)\n", recording->GetFrames(),
+               recording->GetEvents(), recordFilename.c_str(), static_cast<unsigned long long>(seed));
+    }
+
     chip8.MemoryDump();
 
     printf("Quit\n");
@@ -5,7 +5,6 @@
  */
 void Chip8::OP_NULL() {
     // do nothing
-    printf("Instr: NULL OP\n");
 }
 
 /**
@@ -13,10 +12,9 @@ void Chip8::OP_NULL() {
  * Clear the display.
  */
 void Chip8::OP_00E0() {
-    printf("Instr: CLS\n");
-
     // set video buffer to zeroes
     memset(video, 0, sizeof(video));
+    MarkDirty(ALL_ROWS);
 }
 
 /**
@@ -24,21 +22,95 @@ void Chip8::OP_00E0() {
  * Return from a subroutine/function.
  */
 void Chip8::OP_00EE() {
-    printf("Instr: RET\n");
-    printf("SP: %d\n", sp);
-
     sp--;
     pc = stack[sp];
 }
 
+/**
+ * SCD nibble (0x00Cn)
+ * Scroll the display down n rows.
+ */
+void Chip8::OP_00Cn() {
+    unsigned int rows = instr->n;
+    unsigned int height = GetVideoHeight();
+
+    if (rows > height) {
+        rows = height;
+    }
+
+    // move whole rows, then clear the rows scrolled in at the top
+    memmove(&video[rows], &video[0], (height - rows) * sizeof(video[0]));
+    memset(&video[0], 0, rows * sizeof(video[0]));
+    MarkDirty(ALL_ROWS);
+}
+
+/**
+ * SCR (0x00FB)
+ * Scroll the display right 4 pixels.
+ */
+void Chip8::OP_00FB() {
+    for (unsigned int y = 0; y < GetVideoHeight(); y++) {
+        if (highRes) {
+            video[y][1] = (video[y][1] >> 4u) | (video[y][0] << 60u);
+        }
+        video[y][0] >>= 4u;
+    }
+    MarkDirty(ALL_ROWS);
+}
+
+/**
+ * SCL (0x00FC)
+ * Scroll the display left 4 pixels.
+ */
+void Chip8::OP_00FC() {
+    for (unsigned int y = 0; y < GetVideoHeight(); y++) {
+        video[y][0] = (video[y][0] << 4u) | (video[y][1] >> 60u);
+        video[y][1] <<= 4u;
+    }
+    MarkDirty(ALL_ROWS);
+}
+
+/**
+ * EXIT (0x00FD)
+ * Stop the interpreter.
+ */
+void Chip8::OP_00FD() {
+    halted = true;
+    pc -= 2; // stay on the EXIT instruction
+}
+
+/**
+ * LOW (0x00FE)
+ * Switch to 64x32 low resolution and clear the display.
+ */
+void Chip8::OP_00FE() {
+    highRes = false;
+    memset(video, 0, sizeof(video));
+    MarkDirty(ALL_ROWS);
+}
+
+/**
+ * HIGH (0x00FF)
+ * Switch to 128x64 high resolution and clear the display.
+ */
+void Chip8::OP_00FF() {
+    highRes = true;
+    memset(video, 0, sizeof(video));
+    MarkDirty(ALL_ROWS);
+}
+
 /**
  * JUMP (0x1nnn)
  * Jump to the address 0xnnn.
  */
 void Chip8::OP_1nnn() {
-    printf("Instr: JUMP to 0x%03x\n", opcode & 0x0FFFu);
+    uint16_t address = instr->nnn; // last 3 nibbles
+    uint16_t back = pc - address;
 
-    uint16_t address = opcode & 0x0FFFu; // last 3 nibbles
+    // a short way back to an Ex or Fx instruction may close an idle loop, SkipIdle checks
+    if (back >= 2 * INSTRUCTION_WIDTH && back <= MAX_FUSED_LENGTH * INSTRUCTION_WIDTH && memory[address] >= 0xE0) {
+        idle = true;
+    }
 
     pc = address;
 }
@@ -48,13 +120,10 @@ void Chip8::OP_1nnn() {
  * Call the subroutine at adrres 0xnnn.
  */
 void Chip8::OP_2nnn() {
-    printf("Instr: CALL 0x%03x\n", opcode & 0x0FFFu);
-
-    uint16_t address = opcode & 0x0FFFu;
+    uint16_t address = instr->nnn;
 
     stack[sp] = pc; // put next seq instruction on stack
     sp++;
-    printf("SP: %d\n", sp);
 
     pc = address; // execute subroutine
 }
@@ -64,10 +133,8 @@ void Chip8::OP_2nnn() {
  * Skip next instruction if Vx == kk.
  */
 void Chip8::OP_3xkk() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u; // get reg index
-    uint8_t byte = opcode & 0x00FFu; // get byte kk
-
-    printf("Instr: SE if V%01x == 0x%02x\n", x, byte);
+    uint8_t x = instr->x; // get reg index
+    uint8_t byte = instr->kk; // get byte kk
 
     if (V[x] == byte) {
         pc += 2; // skip instruction
@@ -79,10 +146,8 @@ void Chip8::OP_3xkk() {
  * Skip next instruction if Vx != kk.
  */
 void Chip8::OP_4xkk() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u; // get reg index
-    uint8_t byte = opcode & 0x00FFu;
-
-    printf("Instr: SNE if V%01x != 0x%02x\n", x, byte);
+    uint8_t x = instr->x; // get reg index
+    uint8_t byte = instr->kk;
 
     if (V[x] != byte) {
         pc += 2;
@@ -94,10 +159,8 @@ void Chip8::OP_4xkk() {
  * Skip next instruction if Vx == Vy.
  */
 void Chip8::OP_5xy0() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u; // Vx index
-    uint8_t y = (opcode & 0x00F0u) >> 4u; // Vy index
-
-    printf("Instr: SE if V%01x == V%01x\n", x, y);
+    uint8_t x = instr->x; // Vx index
+    uint8_t y = instr->y; // Vy index
 
     if (V[x] == V[y]) {
         pc += 2;
@@ -109,10 +172,8 @@ void Chip8::OP_5xy0() {
  * Load byte kk into register x.
  */
 void Chip8::OP_6xkk() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u; // get reg index
-    uint8_t byte = (opcode & 0x00FFu);
-
-    printf("Instr: LD V%01x, 0x%02x\n", x, byte);
+    uint8_t x = instr->x; // get reg index
+    uint8_t byte = instr->kk;
 
     V[x] = byte;
 }
@@ -122,10 +183,8 @@ void Chip8::OP_6xkk() {
  * Add byte to Vx.
  */
 void Chip8::OP_7xkk() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u; // get reg index
-    uint8_t byte = opcode & 0x00FFu; // get byte
-
-    printf("Instr: ADD V%01x, 0x%02x\n", x, byte);
+    uint8_t x = instr->x; // get reg index
+    uint8_t byte = instr->kk; // get byte
 
     V[x] += byte;
 }
@@ -135,10 +194,8 @@ void Chip8::OP_7xkk() {
  * Set Vx = Vy.
  */
 void Chip8::OP_8xy0() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0x00F0u) >> 4u;
-
-    printf("Instr: LD V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     V[x] = V[y];
 }
@@ -148,10 +205,8 @@ void Chip8::OP_8xy0() {
  * Set Vx |= Vy
  */
 void Chip8::OP_8xy1() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0x00F0u) >> 4u;
-
-    printf("Instr: OR V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     V[x] |= V[y];
 }
@@ -161,10 +216,8 @@ void Chip8::OP_8xy1() {
  * Set Vx &= Vy
  */
 void Chip8::OP_8xy2() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0x00F0u) >> 4u;
-
-    printf("Instr: AND V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     V[x] &= V[y];
 }
@@ -174,10 +227,8 @@ void Chip8::OP_8xy2() {
  * Set Vx |= Vy
  */
 void Chip8::OP_8xy3() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0x00F0u) >> 4u;
-
-    printf("Instr: XOR V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     V[x] ^= V[y];
 }
@@ -188,10 +239,8 @@ void Chip8::OP_8xy3() {
  * Set Vf = carry
  */
 void Chip8::OP_8xy4() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0x00F0u) >> 4u;
-
-    printf("Instr: ADD V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     uint16_t sum = V[x] + V[y];
 
@@ -206,10 +255,8 @@ void Chip8::OP_8xy4() {
  * Set = NOT borrow
  */
 void Chip8::OP_8xy5() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0X00F0u) >> 4u;
-
-    printf("Instr: SUB V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     V[0xF] = V[x] > V[y] ? 1 : 0;
 
@@ -222,9 +269,7 @@ void Chip8::OP_8xy5() {
  * Set Vf if least sig bit is 1
  */
 void Chip8::OP_8xy6() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: SHR V%01x\n", x);
+    uint8_t x = instr->x;
 
     // save least sig bit in VF
     V[0xF] = (V[x] & 0x1u);
@@ -238,10 +283,8 @@ void Chip8::OP_8xy6() {
  * Set Vf = NOT borrow
  */
 void Chip8::OP_8xy7() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0x00F0u) >> 4u;
-
-    printf("Instr: SUBN V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     V[0xF] = V[y] > V[x] ? 1 : 0;
 
@@ -254,9 +297,7 @@ void Chip8::OP_8xy7() {
  * Set Vf = LSB of Vx
  */
 void Chip8::OP_8xyE() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: SHL V%01x\n", x);
+    uint8_t x = instr->x;
 
     V[0xF] = (V[x] & 0x80u) >> 7u;
 
@@ -268,10 +309,8 @@ void Chip8::OP_8xyE() {
  * Skip next instruction if Vx != Vy
  */
 void Chip8::OP_9xy0() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-    uint8_t y = (opcode & 0x00F0u) >> 4u;
-
-    printf("Instr: SNE V%01x, V%01x\n", x, y);
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
     if (V[x] != V[y]) {
         pc += 2;
@@ -283,9 +322,7 @@ void Chip8::OP_9xy0() {
  * Set I = addr. (index register)
  */
 void Chip8::OP_Annn() {
-    uint16_t address = opcode & 0x0FFFu;
-
-    printf("Instr: LD I, 0x%03x\n", address);
+    uint16_t address = instr->nnn;
 
     I = address;
 }
@@ -295,9 +332,7 @@ void Chip8::OP_Annn() {
  * Jump to address nnn + V0
  */
 void Chip8::OP_Bnnn() {
-    uint16_t address = opcode & 0x0FFFu;
-
-    printf("Instr: JUMP V0, 0x%03x\n", address);
+    uint16_t address = instr->nnn;
 
     pc = V[0] + address;
 }
@@ -307,12 +342,10 @@ void Chip8::OP_Bnnn() {
  * Set Vx = random byte AND kk
  */
 void Chip8::OP_Cxkk() {
-    uint8_t x = (opcode & 0x0F00) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+    uint8_t x = instr->x;
+    uint8_t byte = instr->kk;
 
-    printf("Instr: RND V%01x, 0x%02x\n", x, byte);
-
-    V[x] = randByte(randGen) & byte;
+    V[x] = RandomByte() & byte;
 }
 
 /**
@@ -321,35 +354,74 @@ void Chip8::OP_Cxkk() {
  * Set set Vf = collision.
  */
 void Chip8::OP_Dxyn() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u; // get reg index
-    uint8_t y = (opcode & 0x00F0u) >> 4u; // get reg index
-    uint8_t height = opcode & 0x000Fu;
-
-    printf("Instr: DRW V%01x, V%01x, 0x%01x\n", x, y, height);
+    uint8_t x = instr->x; // get reg index
+    uint8_t y = instr->y; // get reg index
+    uint8_t height = instr->n;
 
     // wrap beyond screen boundaries
-    uint8_t xPos = V[x] % VIDEO_WIDTH;
-    uint8_t yPos = V[y] % VIDEO_HEIGHT;
+    uint8_t xPos = V[x] % GetVideoWidth();
+    uint8_t yPos = V[y] % GetVideoHeight();
+
+    uint64_t collision = 0;
+    uint64_t rows = 0;
 
-    V[0xF] = 0; // set Vf
+    // sprites are clipped at the bottom edge
+    for (unsigned int row = 0; row < height && yPos + row < GetVideoHeight(); row++) {
+        collision |= BlitRow(yPos + row, static_cast<uint64_t>(memory[I + row]) << 56u, xPos);
+        rows |= 1ull << (yPos + row);
+    }
 
-    for (unsigned int row = 0; row < height; row++) {
-        uint8_t spriteByte = memory[I + row];
+    MarkDirty(rows);
 
-        for (unsigned int col = 0; col < 8; col++) { // 1 byte
-            uint8_t spritePixel = spriteByte & (0x80u >> col);
-            uint32_t* screenPixel = &video[(yPos + row) * VIDEO_WIDTH + (xPos + col)];
+    V[0xF] = collision ? 1 : 0; // set Vf
+}
 
-            if (spritePixel) { // if sprite pixel on
-                if (*screenPixel == 0xFFFFFFFF) { // if screen pixel on
-                    V[0xF] = 1; // collision
-                }
+/**
+ * DRW Vx, Vy, 0 (0xDxy0)
+ * Display a 16x16 sprite starting at memory location I at (Vx, Vy).
+ * Each row is two bytes. Set Vf = collision.
+ */
+void Chip8::OP_Dxy0() {
+    uint8_t x = instr->x;
+    uint8_t y = instr->y;
 
-                // XOR screen pixel with sprite pixel
-                *screenPixel ^= 0xFFFFFFFF;
-            }
-        }
+    uint8_t xPos = V[x] % GetVideoWidth();
+    uint8_t yPos = V[y] % GetVideoHeight();
+
+    uint64_t collision = 0;
+    uint64_t rows = 0;
+
+    for (unsigned int row = 0; row < 16 && yPos + row < GetVideoHeight(); row++) {
+        uint64_t spriteRow = (memory[I + row * 2] << 8u) | memory[I + row * 2 + 1];
+        collision |= BlitRow(yPos + row, spriteRow << 48u, xPos);
+        rows |= 1ull << (yPos + row);
+    }
+
+    MarkDirty(rows);
+
+    V[0xF] = collision ? 1 : 0;
+}
+
+/**
+ * XOR a left-aligned sprite row onto display row y at xPos.
+ * The row is split across the two words and clipped at the right edge.
+ * Returns the pixels that were already on.
+ */
+uint64_t Chip8::BlitRow(unsigned int y, uint64_t sprite, unsigned int xPos) {
+    uint64_t left = xPos < 64 ? sprite >> xPos : 0;
+    uint64_t right = xPos == 0 ? 0 : xPos < 64 ? sprite << (64 - xPos) : sprite >> (xPos - 64);
+
+    // low resolution is only one word wide
+    if (!highRes) {
+        right = 0;
     }
+
+    uint64_t collision = (video[y][0] & left) | (video[y][1] & right);
+
+    video[y][0] ^= left;
+    video[y][1] ^= right;
+
+    return collision;
 }
 
 /**
@@ -357,11 +429,9 @@ void Chip8::OP_Dxyn() {
  * Skip the next instruction if the key with value stored in Vx is pressed.
  */
 void Chip8::OP_Ex9E() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
+    uint8_t x = instr->x;
     uint8_t key = V[x];
 
-    printf("Instr: SKP V%01x\n", x);
-
     if (keypad[key]) {
         pc += 2;
     }
@@ -372,11 +442,9 @@ void Chip8::OP_Ex9E() {
  * Skip the next instruction if the key with value stored in Vx is not pressed.
  */
 void Chip8::OP_ExA1() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
+    uint8_t x = instr->x;
     uint8_t key = V[x];
 
-    printf("Instr: SKNP V%01x\n", x);
-
     if (!keypad[key]) {
         pc += 2;
     }
@@ -387,41 +455,38 @@ void Chip8::OP_ExA1() {
  * Set Vx = delay timer value.
  */
 void Chip8::OP_Fx07() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: LD V%01x, DT\n", x);
+    uint8_t x = instr->x;
 
     V[x] = delayTimer;
 }
 
 /** 
  * LD Vx, K
- * Wait for a key press
+ * Wait for a key to be pressed and released.
  * Store the key value in Vx.
  */
 void Chip8::OP_Fx0A() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-	if (keypad[0]) { V[x] = 0; }
-	else if (keypad[1])  { V[x] = 1; }
-	else if (keypad[2])  { V[x] = 2; }
-	else if (keypad[3])  { V[x] = 3; }
-	else if (keypad[4])  { V[x] = 4; }
-	else if (keypad[5])  { V[x] = 5; }
-	else if (keypad[6])  { V[x] = 6; }
-	else if (keypad[7])  { V[x] = 7; }
-	else if (keypad[8])  { V[x] = 8; }
-	else if (keypad[9])  { V[x] = 9; }
-	else if (keypad[10]) { V[x] = 10; }
-	else if (keypad[11]) { V[x] = 11; }
-	else if (keypad[12]) { V[x] = 12; }
-	else if (keypad[13]) { V[x] = 13; }
-	else if (keypad[14]) { V[x] = 14; }
-	else if (keypad[15]) { V[x] = 15; }
-	else {
-		pc -= 2;
-	}
+    uint8_t x = instr->x;
+
+    // the first key to go down is the one reported
+    if (keyWait == KEY_WAIT_NONE) {
+        for (uint8_t key = 0; key < 16; key++) {
+            if (keypad[key]) {
+                keyWait = key;
+                break;
+            }
+        }
+    } else if (!keypad[keyWait]) {
+        V[x] = keyWait;
+        keyWait = KEY_WAIT_NONE;
+        waitingForKey = false;
+        return;
+    }
 
+    // keep executing this instruction until then
+    waitingForKey = true;
+    pc -= 2;
+    idle = true;
 }
 
 /**
@@ -429,9 +494,7 @@ void Chip8::OP_Fx0A() {
  * Set delay timer = Vx
  */
 void Chip8::OP_Fx15() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: LD DT, V%01x\n", x);
+    uint8_t x = instr->x;
 
     delayTimer = V[x];
 }
@@ -441,9 +504,7 @@ void Chip8::OP_Fx15() {
  * Set sound timer = Vx
  */
 void Chip8::OP_Fx18() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: LD ST, V%01x\n", x);
+    uint8_t x = instr->x;
 
     soundTimer = V[x];
 }
@@ -453,9 +514,7 @@ void Chip8::OP_Fx18() {
  * Set I = I + Vx
  */
 void Chip8::OP_Fx1E() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: I, V%01x\n", x);
+    uint8_t x = instr->x;
 
     I += V[x];
 }
@@ -465,24 +524,32 @@ void Chip8::OP_Fx1E() {
  * Set I = location of sprite for digit Vx
  */
 void Chip8::OP_Fx29() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
+    uint8_t x = instr->x;
     
-    printf("Instr: LD F, V%01x\n", x);
-
     uint8_t digit = V[x];
 
     I = FONTSET_START_ADDRESS + (digit * FONT_SIZE);
 }
 
+/**
+ * LD HF, Vx
+ * Set I = location of SCHIP 8x10 sprite for digit Vx
+ */
+void Chip8::OP_Fx30() {
+    uint8_t x = instr->x;
+
+    uint8_t digit = V[x] & 0x0Fu;
+
+    I = BIG_FONTSET_START_ADDRESS + (digit * BIG_FONT_SIZE);
+}
+
 /**
  * LD B, Vx
  * Store BCD (binary coded decimal) representation of Vx in memory
  * locations I, I+1 and I+2.
  */
 void Chip8::OP_Fx33() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: LD B, V%01x\n", x);
+    uint8_t x = instr->x;
 
     uint8_t value = V[x];
 
@@ -496,6 +563,8 @@ void Chip8::OP_Fx33() {
 
     // Hundreds
     memory[I] = value % 10;
+
+    InvalidateCache(I, 3);
 }
 
 /**
@@ -503,13 +572,13 @@ void Chip8::OP_Fx33() {
  * Store registers V0 to Vx in memory, starting at location I.
  */
 void Chip8::OP_Fx55() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: LD [I], V%01x\n", x);                   
+    uint8_t x = instr->x;
 
     for (uint8_t i = 0; i <= x; i++) {
         memory[I + i] = V[i];
     }
+
+    InvalidateCache(I, x + 1);
 }
 
 /**
@@ -517,11 +586,333 @@ void Chip8::OP_Fx55() {
  * Read (load) registers V0 to Vx from memory starting at location I.
  */
 void Chip8::OP_Fx65() {
-    uint8_t x = (opcode & 0x0F00u) >> 8u;
-
-    printf("Instr: LD V%01x, [I]\n", x);
+    uint8_t x = instr->x;
 
     for (uint8_t i = 0; i <= x; i++) {
         V[i] = memory[I + i];
     }
-}
\ No newline at end of file
+}
+
+/**
+ * LD R, Vx
+ * Store registers V0 to Vx in the RPL user flags (x <= 7).
+ */
+void Chip8::OP_Fx75() {
+    uint8_t x = instr->x;
+
+    for (uint8_t i = 0; i <= x && i < RPL_FLAGS; i++) {
+        rplFlags[i] = V[i];
+    }
+}
+
+/**
+ * LD Vx, R
+ * Read registers V0 to Vx from the RPL user flags (x <= 7).
+ */
+void Chip8::OP_Fx85() {
+    uint8_t x = instr->x;
+
+    for (uint8_t i = 0; i <= x && i < RPL_FLAGS; i++) {
+        V[i] = rplFlags[i];
+    }
+}
+
+/*
+ * Superinstructions. Each runs the handlers of the instructions it covers
+ * back to back, stepping instr and pc the way the dispatch loop would.
+ */
+
+/**
+ * LD I, addr; DRW Vx, Vy, nibble
+ * Point I at a sprite and draw it.
+ */
+void Chip8::OP_Annn_Dxyn() {
+    OP_Annn();
+    StepFused();
+    OP_Dxyn();
+
+    fusions[OPERATION_Annn_Dxyn]++;
+}
+
+/**
+ * LD Vx, byte; LD Vy, byte
+ */
+void Chip8::OP_6xkk_6xkk() {
+    OP_6xkk();
+    StepFused();
+    OP_6xkk();
+
+    fusions[OPERATION_6xkk_6xkk]++;
+}
+
+/**
+ * LD Vx, byte; LD Vy, byte; LD Vz, byte
+ */
+void Chip8::OP_6xkk_6xkk_6xkk() {
+    OP_6xkk();
+    StepFused();
+    OP_6xkk();
+    StepFused();
+    OP_6xkk();
+
+    fusions[OPERATION_6xkk_6xkk_6xkk]++;
+}
+
+/**
+ * ADD Vx, byte; SE Vy, byte
+ * Loop counter step and test.
+ */
+void Chip8::OP_7xkk_3xkk() {
+    OP_7xkk();
+    StepFused();
+    OP_3xkk();
+
+    fusions[OPERATION_7xkk_3xkk]++;
+}
+
+/**
+ * ADD Vx, byte; SNE Vy, byte
+ * Loop counter step and test.
+ */
+void Chip8::OP_7xkk_4xkk() {
+    OP_7xkk();
+    StepFused();
+    OP_4xkk();
+
+    fusions[OPERATION_7xkk_4xkk]++;
+}
+
+/**
+ * LD Vx, DT; SE Vy, byte; JP addr
+ * Timer wait. The jump only runs if SE didn't skip it.
+ */
+void Chip8::OP_Fx07_3xkk_1nnn() {
+    uint16_t start = pc - INSTRUCTION_WIDTH;
+
+    OP_Fx07();
+    StepFused();
+
+    uint16_t next = pc;
+    OP_3xkk();
+
+    if (pc == next) {
+        StepFused();
+        OP_1nnn();
+    }
+
+    // back at the start, so this may be a timer wait
+    idle = pc == start;
+
+    fusions[OPERATION_Fx07_3xkk_1nnn]++;
+}
+
+/**
+ * LD Vx, DT; SNE Vy, byte; JP addr
+ * Timer wait. The jump only runs if SNE didn't skip it.
+ */
+void Chip8::OP_Fx07_4xkk_1nnn() {
+    uint16_t start = pc - INSTRUCTION_WIDTH;
+
+    OP_Fx07();
+    StepFused();
+
+    uint16_t next = pc;
+    OP_4xkk();
+
+    if (pc == next) {
+        StepFused();
+        OP_1nnn();
+    }
+
+    idle = pc == start;
+
+    fusions[OPERATION_Fx07_4xkk_1nnn]++;
+}
+
+/**
+ * SKP Vx; JP addr
+ * The jump only runs if the key isn't pressed.
+ */
+void Chip8::OP_Ex9E_1nnn() {
+    uint16_t start = pc - INSTRUCTION_WIDTH;
+    uint16_t next = pc;
+
+    OP_Ex9E();
+
+    if (pc == next) {
+        StepFused();
+        OP_1nnn();
+    }
+
+    idle = pc == start;
+
+    fusions[OPERATION_Ex9E_1nnn]++;
+}
+
+/**
+ * SKNP Vx; JP addr
+ * The jump only runs if the key is pressed.
+ */
+void Chip8::OP_ExA1_1nnn() {
+    uint16_t start = pc - INSTRUCTION_WIDTH;
+    uint16_t next = pc;
+
+    OP_ExA1();
+
+    if (pc == next) {
+        StepFused();
+        OP_1nnn();
+    }
+
+    idle = pc == start;
+
+    fusions[OPERATION_ExA1_1nnn]++;
+}
+
+/**
+ * Get the decoded instruction at an address.
+ * Program space is served from the decode cache, which is filled on
+ * first use. Anything else is decoded on every fetch.
+ */
+const Chip8::Instruction& Chip8::Fetch(uint16_t address) {
+    // fast path, already decoded program space
+    if (address - START_ADDRESS < DECODE_CACHE_SIZE && decodeCache[address - START_ADDRESS].length != 0) {
+        return decodeCache[address - START_ADDRESS];
+    }
+
+    address &= MEMORY_SIZE - 1;
+
+    if (address < START_ADDRESS) {
+        Decode((memory[address] << 8u) | memory[address + 1], decodeScratch);
+        return decodeScratch;
+    }
+
+    Instruction& entry = decodeCache[address - START_ADDRESS];
+
+    // length 0 is not decoded yet, or only decoded as part of another instruction's fusion
+    if (entry.length == 0) {
+        if (entry.handler == nullptr) {
+            Decode((memory[address] << 8u) | memory[(address + 1) & (MEMORY_SIZE - 1)], entry);
+        }
+
+        if (fusion) {
+            Fuse(address, entry);
+        }
+    }
+
+    return entry;
+}
+
+/**
+ * Fetch the next instruction for the interpreter loops. A superinstruction
+ * that would overrun the remaining budget, or hide instructions from an
+ * attached trace, runs as its first instruction only.
+ */
+inline const Chip8::Instruction* Chip8::Next(uint32_t budget) {
+    const Instruction* next = &Fetch(pc);
+
+    if (next->length > 1 && (next->length > budget || IsTracing())) {
+        Decode(next->opcode, decodeScratch);
+        next = &decodeScratch;
+    }
+
+    return next;
+}
+
+/*
+ * Interpreter loops, one per dispatch strategy. They live here rather than
+ * in chip8.cpp so the switch and goto versions can inline Fetch and the
+ * handlers above.
+ */
+
+/**
+ * Check whether an operation's handler can flag an idle loop.
+ */
+static constexpr bool MayIdle(Operation operation) {
+    return operation == OPERATION_1nnn || operation == OPERATION_Fx0A || operation == OPERATION_Fx07_3xkk_1nnn
+        || operation == OPERATION_Fx07_4xkk_1nnn || operation == OPERATION_Ex9E_1nnn || operation == OPERATION_ExA1_1nnn;
+}
+
+/**
+ * Execute up to the given number of instructions, stopping early on EXIT.
+ * Idle loops are fast-forwarded to the end of the budget.
+ * Returns the number of instructions executed.
+ */
+template <Dispatch dispatch>
+uint32_t Chip8::Interpret(uint32_t instructions) {
+    uint32_t executed = 0;
+    const Instruction* head; // first instruction, fused handlers move instr on from it
+
+#if defined(__GNUC__)
+    if constexpr (dispatch == DISPATCH_GOTO) {
+        static const void* const labels[OPERATION_COUNT] = {
+#define CHIP8_OPERATION_LABEL(name) &&label_##name,
+            CHIP8_OPERATIONS(CHIP8_OPERATION_LABEL)
+#undef CHIP8_OPERATION_LABEL
+        };
+
+        if (instructions == 0 || halted) {
+            return 0;
+        }
+
+        // each handler jumps straight to the next one, with no shared dispatch branch
+#define CHIP8_DISPATCH_NEXT() \
+        instr = head = Next(instructions - executed); \
+        opcode = instr->opcode; \
+        TRACE_RECORD(trace, pc, opcode, I, sp); \
+        pc += 2; \
+        goto *labels[instr->operation]
+
+        CHIP8_DISPATCH_NEXT();
+
+#define CHIP8_OPERATION_CASE(name) \
+    label_##name: \
+        OP_##name(); \
+        executed += (instr - head) / INSTRUCTION_WIDTH + 1; \
+        if (MayIdle(OPERATION_##name) && idle) { \
+            executed += SkipIdle(instructions - executed); \
+        } \
+        if (executed >= instructions || (OPERATION_##name == OPERATION_00FD && halted)) { \
+            return executed; \
+        } \
+        CHIP8_DISPATCH_NEXT();
+
+        CHIP8_OPERATIONS(CHIP8_OPERATION_CASE)
+#undef CHIP8_OPERATION_CASE
+#undef CHIP8_DISPATCH_NEXT
+    }
+#endif
+
+    while (executed < instructions && !halted) {
+        instr = head = Next(instructions - executed);
+        opcode = instr->opcode;
+
+        TRACE_RECORD(trace, pc, opcode, I, sp);
+
+        pc += 2;
+
+        if constexpr (dispatch == DISPATCH_TABLE) {
+            ((*this).*(instr->handler))();
+        } else {
+            // also the fallback for goto on compilers without computed goto
+            switch (instr->operation) {
+#define CHIP8_OPERATION_CASE(name) case OPERATION_##name: OP_##name(); break;
+                CHIP8_OPERATIONS(CHIP8_OPERATION_CASE)
+#undef CHIP8_OPERATION_CASE
+                default: break;
+            }
+        }
+
+        executed += (instr - head) / INSTRUCTION_WIDTH + 1;
+
+        if (idle) {
+            executed += SkipIdle(instructions - executed);
+        }
+    }
+
+    return executed;
+}
+
+template uint32_t Chip8::Interpret<DISPATCH_TABLE>(uint32_t instructions);
+template uint32_t Chip8::Interpret<DISPATCH_SWITCH>(uint32_t instructions);
+template uint32_t Chip8::Interpret<DISPATCH_GOTO>(uint32_t instructions);
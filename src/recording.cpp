@@ -0,0 +1,204 @@
+#include "recording.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+Recording::Recording()
+    : seed(0), romHash(0), instructionsPerFrame(0), frames(0), keys(0), cursor(0) {
+}
+
+/**
+ * Start a new recording for a ROM.
+ * Returns false if the ROM can't be read.
+ */
+bool Recording::Begin(uint64_t seed, uint32_t instructionsPerFrame, const char* romFilename) {
+    this->seed = seed;
+    this->instructionsPerFrame = instructionsPerFrame;
+    frames = 0;
+    events.clear();
+    keys = 0;
+    cursor = 0;
+
+    return HashFile(romFilename, romHash);
+}
+
+/**
+ * Log the keypad a frame is about to run with.
+ * Only keys that changed since the last call are stored.
+ */
+void Recording::Record(uint32_t frame, uint16_t keys) {
+    uint16_t changed = this->keys ^ keys;
+
+    for (uint8_t key = 0; key < 16; key++) {
+        if ((changed >> key) & 1u) {
+            events.push_back({frame, key, ((keys >> key) & 1u) != 0});
+        }
+    }
+
+    this->keys = keys;
+}
+
+/**
+ * Close the recording after the given number of frames.
+ */
+void Recording::End(uint32_t frames) {
+    this->frames = frames;
+}
+
+/**
+ * Write the recording to a file.
+ */
+bool Recording::Save(const char* filename) const {
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Unable to write recording: " << filename << std::endl;
+        return false;
+    }
+
+    RecordingHeader header = {}; // zeroes the padding, so equal sessions save to equal files
+    memcpy(header.magic, RECORDING_MAGIC, sizeof(header.magic));
+    header.version = RECORDING_VERSION;
+    header.seed = seed;
+    header.romHash = romHash;
+    header.instructionsPerFrame = instructionsPerFrame;
+    header.frames = frames;
+    header.events = events.size();
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    std::vector<uint8_t> out;
+    uint32_t previous = 0;
+
+    for (const KeyEvent& event : events) {
+        // frame delta as a varint, 7 bits at a time
+        uint32_t delta = event.frame - previous;
+        while (delta >= 0x80) {
+            out.push_back(0x80 | (delta & 0x7F));
+            delta >>= 7;
+        }
+        out.push_back(delta);
+
+        out.push_back(event.key | (event.pressed ? 0x10 : 0x00));
+        previous = event.frame;
+    }
+
+    file.write(reinterpret_cast<const char*>(out.data()), out.size());
+
+    return file.good();
+}
+
+/**
+ * Read a recording from a file.
+ * Returns false if the file is missing, truncated or from a different
+ * format version.
+ */
+bool Recording::Load(const char* filename) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Invalid recording: " << filename << std::endl;
+        return false;
+    }
+
+    RecordingHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || memcmp(header.magic, RECORDING_MAGIC, sizeof(header.magic)) != 0) {
+        std::cerr << "ERROR: Not a recording: " << filename << std::endl;
+        return false;
+    }
+
+    if (header.version != RECORDING_VERSION) {
+        std::cerr << "ERROR: Recording version " << header.version << " is not supported (expected "
+                  << RECORDING_VERSION << "): " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> in((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    events.clear();
+    size_t at = 0;
+    uint32_t frame = 0;
+
+    for (uint32_t i = 0; i < header.events; i++) {
+        uint32_t delta = 0;
+        unsigned int shift = 0;
+
+        while (at < in.size() && (in[at] & 0x80) && shift < 28) {
+            delta |= (in[at++] & 0x7Fu) << shift;
+            shift += 7;
+        }
+
+        if (at + 2 > in.size()) {
+            std::cerr << "ERROR: Truncated recording: " << filename << std::endl;
+            return false;
+        }
+
+        delta |= in[at++] << shift;
+        frame += delta;
+
+        uint8_t entry = in[at++];
+        events.push_back({frame, static_cast<uint8_t>(entry & 0x0F), (entry & 0x10) != 0});
+    }
+
+    seed = header.seed;
+    romHash = header.romHash;
+    instructionsPerFrame = header.instructionsPerFrame;
+    frames = header.frames;
+    keys = 0;
+    cursor = 0;
+
+    return true;
+}
+
+/**
+ * Check a ROM file against the one the recording was made with.
+ */
+bool Recording::MatchesROM(const char* romFilename) const {
+    uint64_t hash;
+    return HashFile(romFilename, hash) && hash == romHash;
+}
+
+/**
+ * Get the keypad for a frame during playback.
+ * Frames must be asked for in increasing order.
+ */
+uint16_t Recording::GetKeys(uint32_t frame) {
+    while (cursor < events.size() && events[cursor].frame <= frame) {
+        const KeyEvent& event = events[cursor++];
+
+        if (event.pressed) {
+            keys |= 1u << event.key;
+        } else {
+            keys &= ~(1u << event.key);
+        }
+    }
+
+    return keys;
+}
+
+uint32_t Recording::GetNextEventFrame() const {
+    return cursor < events.size() ? events[cursor].frame : frames;
+}
+
+/**
+ * FNV-1a hash of a file's contents.
+ */
+bool Recording::HashFile(const char* filename, uint64_t& hash) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "ERROR: Invalid ROM file: " << filename << std::endl;
+        return false;
+    }
+
+    hash = 0xcbf29ce484222325ull;
+
+    char buffer[4096];
+    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+        for (std::streamsize i = 0; i < file.gcount(); i++) {
+            hash = (hash ^ static_cast<uint8_t>(buffer[i])) * 0x100000001b3ull;
+        }
+    }
+
+    return true;
+}
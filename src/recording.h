@@ -0,0 +1,75 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+const char RECORDING_MAGIC[4] = {'C', '8', 'R', 'C'};
+const uint32_t RECORDING_VERSION = 1;
+
+struct RecordingHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t seed; // RNG seed the run started from
+    uint64_t romHash; // FNV-1a of the ROM file
+    uint32_t instructionsPerFrame;
+    uint32_t frames; // frames run
+    uint32_t events; // key transitions that follow
+};
+
+/**
+ * One keypad transition, applied before the frame it is stamped with.
+ */
+struct KeyEvent {
+    uint32_t frame;
+    uint8_t key;
+    bool pressed;
+};
+
+/**
+ * Everything needed to repeat a run exactly: the RNG seed, the speed and
+ * every keypad transition, stamped by frame. The core only samples the
+ * keypad between frames, so a frame number pins an event down as exactly
+ * as an instruction count would (frame * instructionsPerFrame).
+ *
+ * On disk a RecordingHeader is followed by one entry per event: the frame
+ * delta from the previous event as an LEB128 varint, then a byte holding
+ * the key in the low nibble and bit 4 set for a press. Fields are in host
+ * byte order, like save states.
+ */
+class Recording {
+public:
+    Recording();
+
+    // recording
+    bool Begin(uint64_t seed, uint32_t instructionsPerFrame, const char* romFilename);
+    void Record(uint32_t frame, uint16_t keys);
+    void End(uint32_t frames);
+    bool Save(const char* filename) const;
+
+    // playback
+    bool Load(const char* filename);
+    bool MatchesROM(const char* romFilename) const;
+    uint16_t GetKeys(uint32_t frame);
+    uint32_t GetNextEventFrame() const; // frame of the next unplayed event, or GetFrames()
+
+    uint64_t GetSeed() const { return seed; }
+    uint32_t GetInstructionsPerFrame() const { return instructionsPerFrame; }
+    uint32_t GetFrames() const { return frames; }
+    size_t GetEvents() const { return events.size(); }
+
+    static bool HashFile(const char* filename, uint64_t& hash);
+
+private:
+    uint64_t seed;
+    uint64_t romHash;
+    uint32_t instructionsPerFrame;
+    uint32_t frames;
+    std::vector<KeyEvent> events;
+
+    uint16_t keys; // keypad as of the last Record or GetKeys call
+    size_t cursor; // next event to play back
+};
+
+#endif
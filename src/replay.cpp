@@ -0,0 +1,98 @@
+#include "chip8.h"
+#include "recording.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <iostream>
+#include <string>
+
+/*
+ * Headless replay of a recording made with the emulator's --record option.
+ * Runs the recorded frames as fast as possible and prints a hash of the
+ * final machine state; two replays of the same recording, on either
+ * engine, must print the same hash.
+ */
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <recording> <ROM> [options]\n"
+                  << "Options:\n"
+                  << "  --jit           run on the x86-64 recompiler\n"
+                  << "  --aot           run the translation from chip8-aot, if linked in\n";
+        return -1;
+    }
+
+    Engine engine = ENGINE_INTERPRETER;
+
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--jit") {
+            engine = ENGINE_JIT;
+        } else if (arg == "--aot") {
+            engine = ENGINE_AOT;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+
+    Recording recording;
+    if (!recording.Load(argv[1])) {
+        return -1;
+    }
+
+    if (!recording.MatchesROM(argv[2])) {
+        std::cerr << "ERROR: " << argv[2] << " is not the ROM this was recorded with" << std::endl;
+        return -1;
+    }
+
+    Chip8 chip8;
+    chip8.SetSeed(recording.GetSeed());
+    if (!chip8.LoadROM(argv[2])) {
+        return -1;
+    }
+
+    if (!chip8.SetEngine(engine)) {
+        std::cerr << (engine == ENGINE_AOT ? "WARNING: No chip8-aot translation of this ROM linked in, using the interpreter\n"
+                                           : "WARNING: JIT not available on this host, using the interpreter\n");
+    }
+
+    uint32_t instructionsPerFrame = recording.GetInstructionsPerFrame();
+    uint32_t frames = recording.GetFrames();
+    uint64_t instructions = 0;
+    uint32_t frame = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    while (frame < frames && !chip8.IsHalted()) {
+        uint16_t keys = recording.GetKeys(frame);
+        for (unsigned int key = 0; key < 16; key++) {
+            chip8.keypad[key] = (keys >> key) & 1u;
+        }
+
+        instructions += chip8.RunFrame(instructionsPerFrame);
+        frame++;
+
+        /* waiting for a key with the timers run down, nothing changes until
+            the next recorded event, so skip to it */
+        if (chip8.IsWaitingForKey() && chip8.GetDelayTimer() == 0 && chip8.GetSoundTimer() == 0) {
+            uint32_t resume = std::min(recording.GetNextEventFrame(), frames);
+            if (resume > frame) {
+                instructions += static_cast<uint64_t>(resume - frame) * instructionsPerFrame;
+                frame = resume;
+            }
+        }
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    printf("frames:       %u of %u%s\n", frame, frames, chip8.IsHalted() ? " (halted)" : "");
+    printf("events:       %zu\n", recording.GetEvents());
+    printf("instructions: %" PRIu64 "\n", instructions);
+    printf("time:         %.1f ms (%.1f MIPS)\n", ms, ms > 0 ? instructions / (ms * 1000.0) : 0.0);
+    printf("state hash:   %016" PRIx64 "\n", chip8.GetStateHash());
+
+    return 0;
+}
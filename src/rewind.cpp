@@ -0,0 +1,196 @@
+#include "rewind.h"
+
+/*
+ * Encoded snapshot: a sequence of runs, each
+ *     uint16_t skip     words equal to the base
+ *     uint16_t literal  words that differ
+ *     uint64_t xor[literal]
+ * covering the whole state.
+ */
+
+RewindBuffer::RewindBuffer(unsigned int frames, unsigned int keyframeInterval)
+    : keyframeInterval(keyframeInterval), oldest(0), count(0), newestValid(false) {
+    // one spare segment, so dropping the oldest still leaves the full history
+    unsigned int segmentCount = (frames + keyframeInterval - 1) / keyframeInterval + 1;
+
+    segments.resize(segmentCount);
+    for (Segment& segment : segments) {
+        segment.deltas.resize(keyframeInterval - 1);
+        segment.frames = 0;
+    }
+}
+
+/**
+ * Append a frame to the history, dropping the oldest segment when full.
+ */
+void RewindBuffer::Push(const Chip8State& state) {
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(&state);
+
+    if (count == 0 || Newest().frames == keyframeInterval) {
+        if (count == segments.size()) {
+            oldest = (oldest + 1) % segments.size();
+            count--;
+        }
+
+        count++;
+        Segment& segment = Newest();
+        Encode(words, nullptr, segment.keyframe);
+        segment.frames = 1;
+    } else {
+        RebuildNewest();
+
+        Segment& segment = Newest();
+        Encode(words, newest, segment.deltas[segment.frames - 1]);
+        segment.frames++;
+    }
+
+    memcpy(newest, words, sizeof(newest));
+    newestValid = true;
+}
+
+/**
+ * Remove the newest frame from the history.
+ * Returns false if the history is empty.
+ */
+bool RewindBuffer::Pop(Chip8State& state) {
+    if (count == 0) {
+        return false;
+    }
+
+    RebuildNewest();
+    memcpy(&state, newest, sizeof(newest));
+
+    Segment& segment = Newest();
+
+    if (segment.frames > 1) {
+        // step back to the frame before
+        Apply(segment.deltas[segment.frames - 2], newest);
+        segment.frames--;
+    } else {
+        // that was the keyframe, the frame before is in the previous segment
+        segment.frames = 0;
+        count--;
+        newestValid = false;
+    }
+
+    return true;
+}
+
+void RewindBuffer::Clear() {
+    oldest = 0;
+    count = 0;
+    newestValid = false;
+}
+
+unsigned int RewindBuffer::GetFrames() const {
+    unsigned int frames = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        frames += segments[(oldest + i) % segments.size()].frames;
+    }
+
+    return frames;
+}
+
+size_t RewindBuffer::GetMemoryUsage() const {
+    size_t bytes = 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        const Segment& segment = segments[(oldest + i) % segments.size()];
+
+        bytes += segment.keyframe.size();
+        for (unsigned int d = 0; d + 1 < segment.frames; d++) {
+            bytes += segment.deltas[d].size();
+        }
+    }
+
+    return bytes;
+}
+
+/**
+ * Rebuild the newest frame from its segment's keyframe, if it isn't cached.
+ */
+void RewindBuffer::RebuildNewest() {
+    if (newestValid || count == 0) {
+        return;
+    }
+
+    Segment& segment = Newest();
+
+    memset(newest, 0, sizeof(newest));
+    Apply(segment.keyframe, newest);
+
+    for (unsigned int d = 0; d + 1 < segment.frames; d++) {
+        Apply(segment.deltas[d], newest);
+    }
+
+    newestValid = true;
+}
+
+/**
+ * Encode state XOR base (base nullptr = zeros). The output vector keeps
+ * its capacity between frames, so steady state capture does not allocate.
+ */
+void RewindBuffer::Encode(const uint64_t* state, const uint64_t* base, std::vector<uint8_t>& out) {
+    static const uint64_t zeros[WORDS] = {};
+    if (base == nullptr) {
+        base = zeros;
+    }
+
+    out.clear();
+
+    unsigned int i = 0;
+    while (i < WORDS) {
+        // skip unchanged words, four at a time while possible
+        unsigned int start = i;
+        while (i + 4 <= WORDS && ((state[i] ^ base[i]) | (state[i + 1] ^ base[i + 1])
+                                  | (state[i + 2] ^ base[i + 2]) | (state[i + 3] ^ base[i + 3])) == 0) {
+            i += 4;
+        }
+        while (i < WORDS && state[i] == base[i]) {
+            i++;
+        }
+        uint16_t skip = i - start;
+
+        start = i;
+        while (i < WORDS && state[i] != base[i]) {
+            i++;
+        }
+        uint16_t literal = i - start;
+
+        size_t at = out.size();
+        out.resize(at + 4 + literal * sizeof(uint64_t));
+        memcpy(&out[at], &skip, 2);
+        memcpy(&out[at + 2], &literal, 2);
+
+        for (unsigned int w = 0; w < literal; w++) {
+            uint64_t delta = state[start + w] ^ base[start + w];
+            memcpy(&out[at + 4 + w * sizeof(uint64_t)], &delta, sizeof(delta));
+        }
+    }
+}
+
+/**
+ * XOR an encoded delta into a state. Since XOR is its own inverse, the
+ * same call steps a frame forward or back.
+ */
+void RewindBuffer::Apply(const std::vector<uint8_t>& in, uint64_t* state) {
+    unsigned int i = 0;
+    size_t at = 0;
+
+    while (at < in.size()) {
+        uint16_t skip;
+        uint16_t literal;
+        memcpy(&skip, &in[at], 2);
+        memcpy(&literal, &in[at + 2], 2);
+        at += 4;
+        i += skip;
+
+        for (unsigned int w = 0; w < literal; w++, i++) {
+            uint64_t delta;
+            memcpy(&delta, &in[at], sizeof(delta));
+            state[i] ^= delta;
+            at += sizeof(delta);
+        }
+    }
+}
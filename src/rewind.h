@@ -0,0 +1,59 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <cstdint>
+#include <vector>
+
+#include "chip8.h"
+
+const unsigned int REWIND_KEYFRAME_INTERVAL = 300; // frames per keyframe, 5 seconds
+const unsigned int DEFAULT_REWIND_SECONDS = 60;
+
+static_assert(sizeof(Chip8State) % sizeof(uint64_t) == 0, "Chip8State is encoded a word at a time");
+
+/**
+ * Bounded history of per-frame snapshots for rewinding.
+ * History is a ring of segments. Each segment starts with a keyframe and
+ * holds the following frames as XOR deltas against the frame before, with
+ * zero words run-length encoded, so a frame that changed a few registers
+ * and sprite rows costs tens of bytes. Stepping back XORs the newest delta
+ * out of the newest state; keyframes bound how far a state has to be
+ * rebuilt when crossing into an older segment. The oldest segment is
+ * dropped as a whole once the ring is full.
+ */
+class RewindBuffer {
+public:
+    RewindBuffer(unsigned int frames, unsigned int keyframeInterval = REWIND_KEYFRAME_INTERVAL);
+
+    void Push(const Chip8State& state);
+    bool Pop(Chip8State& state);
+    void Clear();
+
+    unsigned int GetFrames() const; // frames of history held
+    size_t GetMemoryUsage() const; // encoded bytes held
+
+private:
+    struct Segment {
+        std::vector<uint8_t> keyframe; // encoded against an all-zero state
+        std::vector<std::vector<uint8_t>> deltas; // each encoded against the frame before it
+        unsigned int frames; // keyframe plus deltas in use
+    };
+
+    static const unsigned int WORDS = sizeof(Chip8State) / sizeof(uint64_t);
+
+    static void Encode(const uint64_t* state, const uint64_t* base, std::vector<uint8_t>& out);
+    static void Apply(const std::vector<uint8_t>& in, uint64_t* state);
+
+    Segment& Newest() { return segments[(oldest + count - 1) % segments.size()]; }
+    void RebuildNewest();
+
+    std::vector<Segment> segments;
+    unsigned int keyframeInterval;
+    unsigned int oldest; // index of the oldest segment
+    unsigned int count; // segments in use
+
+    uint64_t newest[WORDS]; // newest frame in the history
+    bool newestValid;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#include "scheduler.h"
+
+#include <chrono>
+#include <thread>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#endif
+
+FrameScheduler::FrameScheduler(unsigned int framesPerSecond)
+    : period(1000000000ll / framesPerSecond), droppedFrames(0) {
+    Reset();
+}
+
+/**
+ * Monotonic time in nanoseconds.
+ */
+int64_t FrameScheduler::Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Start a new schedule, with the first deadline one period from now.
+ */
+void FrameScheduler::Reset() {
+    deadline = Now() + period;
+}
+
+/**
+ * Block until the current frame's deadline, then advance it.
+ */
+void FrameScheduler::Wait() {
+    int64_t now = Now();
+
+    // too far behind to catch up, drop the missed frames
+    if (now - deadline > period) {
+        droppedFrames += (now - deadline) / period;
+        deadline = now + period;
+        return;
+    }
+
+    int64_t wake = deadline - SCHEDULER_SPIN_NS;
+
+    if (wake > now) {
+#if defined(__linux__)
+        // steady_clock is CLOCK_MONOTONIC on Linux
+        timespec until;
+        until.tv_sec = wake / 1000000000ll;
+        until.tv_nsec = wake % 1000000000ll;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, nullptr) == EINTR) {
+            // interrupted by a signal, sleep again
+        }
+#else
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(wake)));
+#endif
+    }
+
+    // spin out the remainder
+    while (Now() < deadline) {
+        std::this_thread::yield();
+    }
+
+    deadline += period;
+}
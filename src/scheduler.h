@@ -0,0 +1,33 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+
+const int64_t SCHEDULER_SPIN_NS = 500000; // busy-wait the last 0.5 ms for a precise wakeup
+
+/**
+ * Fixed-timestep frame pacing.
+ * Wait() sleeps until the next frame deadline on an absolute monotonic
+ * clock, then spins briefly so the wakeup lands on time. Deadlines advance
+ * by exactly one period, so sleep jitter does not accumulate. If the host
+ * falls more than a frame behind, the schedule restarts from now instead
+ * of running a burst of catch-up frames.
+ */
+class FrameScheduler {
+public:
+    FrameScheduler(unsigned int framesPerSecond);
+
+    void Wait();
+    void Reset();
+
+    uint64_t GetDroppedFrames() const { return droppedFrames; }
+
+    static int64_t Now(); // monotonic nanoseconds
+
+private:
+    int64_t period;
+    int64_t deadline;
+    uint64_t droppedFrames;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "stateexport.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/*
+ * Reader for the state an emulator started with --shm=<name> publishes.
+ * Prints the registers of published frames, one line each, as they come.
+ */
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <name> [options]\n"
+                  << "Options:\n"
+                  << "  --frames=<n>    frames to print before exiting (default: 1)\n";
+        return -1;
+    }
+
+    unsigned int frames = 1;
+
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg.rfind("--frames=", 0) == 0) {
+            frames = std::stoi(arg.substr(9));
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            return -1;
+        }
+    }
+
+    StateExport exported;
+    if (!exported.Attach(argv[1])) {
+        return -1;
+    }
+
+    Chip8State state;
+    uint64_t frame;
+    uint64_t last = ~0ull;
+    unsigned int printed = 0;
+
+    while (printed < frames) {
+        if (!exported.Read(state, frame) || frame == last) {
+            // nothing new yet, the emulator publishes at 60 Hz
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        printf("frame %llu: pc %03x i %03x sp %d dt %d st %d v", static_cast<unsigned long long>(frame), state.pc,
+               state.I, state.sp, state.delayTimer, state.soundTimer);
+        for (int reg = 0; reg < 16; reg++) {
+            printf(" %02x", state.V[reg]);
+        }
+        printf("\n");
+        fflush(stdout);
+
+        last = frame;
+        printed++;
+    }
+
+    return 0;
+}
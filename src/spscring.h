@@ -0,0 +1,55 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+
+/**
+ * Lock-free single-producer/single-consumer ring of Capacity - 1 items.
+ * Push fails instead of waiting when the ring is full, Pop when it is
+ * empty. Each index is written by one side only, so neither side ever
+ * waits on the other.
+ */
+template <typename T, size_t Capacity>
+class SpscRing {
+public:
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    SpscRing() : head(0), tail(0) {}
+
+    // producer
+    bool Push(const T& item) {
+        size_t at = tail.load(std::memory_order_relaxed);
+        if (at - head.load(std::memory_order_acquire) == Capacity - 1) {
+            return false;
+        }
+
+        items[at & (Capacity - 1)] = item;
+        tail.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer
+    bool Pop(T& item) {
+        size_t at = head.load(std::memory_order_relaxed);
+        if (at == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        item = items[at & (Capacity - 1)];
+        head.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t Size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[Capacity];
+
+    alignas(64) std::atomic<size_t> head; // next item to pop, consumer only
+    alignas(64) std::atomic<size_t> tail; // next free slot, producer only
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "stateexport.h"
+
+#include <cerrno>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+StateExport::StateExport() : shared(nullptr) {
+}
+
+StateExport::~StateExport() {
+    if (shared != nullptr) {
+        munmap(shared, sizeof(ExportedState));
+    }
+
+    if (!name.empty()) {
+        shm_unlink(name.c_str());
+    }
+}
+
+/**
+ * Map the segment called name, with or without its leading slash.
+ * A writable segment must not exist yet, so two emulators never publish
+ * into one segment and one never unlinks another's.
+ */
+bool StateExport::Map(const char* name, bool writable) {
+    std::string path = name[0] == '/' ? name : std::string("/") + name;
+
+    int fd = shm_open(path.c_str(), writable ? O_RDWR | O_CREAT | O_EXCL : O_RDONLY, 0644);
+    if (fd < 0) {
+        if (writable && errno == EEXIST) {
+            std::cerr << "ERROR: Shared memory " << path << " already exists (in use, or left by a crash: remove /dev/shm"
+                      << path << ")" << std::endl;
+        } else {
+            std::cerr << "ERROR: Unable to open shared memory " << path << std::endl;
+        }
+        return false;
+    }
+
+    if (writable && ftruncate(fd, sizeof(ExportedState)) != 0) {
+        std::cerr << "ERROR: Unable to size shared memory " << path << std::endl;
+        close(fd);
+        shm_unlink(path.c_str());
+        return false;
+    }
+
+    void* memory = mmap(nullptr, sizeof(ExportedState), writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (memory == MAP_FAILED) {
+        std::cerr << "ERROR: Unable to map shared memory " << path << std::endl;
+        if (writable) {
+            shm_unlink(path.c_str());
+        }
+        return false;
+    }
+
+    shared = static_cast<ExportedState*>(memory);
+    if (writable) {
+        this->name = path;
+    }
+
+    return true;
+}
+
+/**
+ * Create the segment and stamp its header. Nothing is readable until the
+ * first Publish.
+ */
+bool StateExport::Create(const char* name) {
+    if (!Map(name, true)) {
+        return false;
+    }
+
+    new (&shared->sequence) std::atomic<uint64_t>(0);
+    shared->frame = 0;
+    memcpy(shared->magic, EXPORT_MAGIC, sizeof(shared->magic));
+    shared->version = EXPORT_VERSION;
+    shared->size = sizeof(ExportedState);
+    shared->stateVersion = SAVE_STATE_VERSION;
+
+    return true;
+}
+
+/**
+ * Publish the machine state. Never blocks.
+ */
+void StateExport::Publish(const Chip8& chip8, uint64_t frame) {
+    uint64_t sequence = shared->sequence.load(std::memory_order_relaxed);
+
+    shared->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    chip8.SaveState(shared->state);
+    shared->frame = frame;
+
+    shared->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+/**
+ * Open a segment another process is publishing to.
+ */
+bool StateExport::Attach(const char* name) {
+    if (!Map(name, false)) {
+        return false;
+    }
+
+    if (memcmp(shared->magic, EXPORT_MAGIC, sizeof(shared->magic)) != 0 || shared->version != EXPORT_VERSION
+        || shared->size != sizeof(ExportedState) || shared->stateVersion != SAVE_STATE_VERSION) {
+        std::cerr << "ERROR: Shared memory " << name << " holds an incompatible export" << std::endl;
+        munmap(shared, sizeof(ExportedState));
+        shared = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Copy out the latest consistent state.
+ * Returns false if nothing has been published yet, or if every attempt
+ * raced a publish.
+ */
+bool StateExport::Read(Chip8State& state, uint64_t& frame) const {
+    for (unsigned int attempt = 0; attempt < EXPORT_READ_ATTEMPTS; attempt++) {
+        uint64_t before = shared->sequence.load(std::memory_order_acquire);
+        if (before == 0) {
+            return false;
+        }
+        if (before & 1u) {
+            continue;
+        }
+
+        memcpy(&state, &shared->state, sizeof(state));
+        frame = shared->frame;
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (shared->sequence.load(std::memory_order_relaxed) == before) {
+            return true;
+        }
+    }
+
+    return false;
+}
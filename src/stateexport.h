@@ -0,0 +1,59 @@
+#ifndef STATEEXPORT_H
+#define STATEEXPORT_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "chip8.h"
+
+const char EXPORT_MAGIC[4] = {'C', '8', 'S', 'M'};
+const uint32_t EXPORT_VERSION = 1;
+const unsigned int EXPORT_READ_ATTEMPTS = 1000; // torn reads retried before Read gives up
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence is shared between processes");
+
+/**
+ * Layout of the shared memory segment.
+ * sequence is odd while the emulator is writing and bumped by two per
+ * publish. A reader copies what it needs between two loads of sequence
+ * and keeps the copy if both were the same even value.
+ */
+struct ExportedState {
+    char magic[4];
+    uint32_t version; // EXPORT_VERSION
+    uint32_t size; // sizeof(ExportedState)
+    uint32_t stateVersion; // SAVE_STATE_VERSION, the layout of state
+
+    alignas(64) std::atomic<uint64_t> sequence;
+    uint64_t frame; // emulated frames so far
+    Chip8State state; // as in a save file: memory, video, registers, ...
+};
+
+/**
+ * The machine state published through a POSIX shared memory segment
+ * (/dev/shm/<name>) once per frame, for local capture and analysis tools.
+ * Publishing is a seqlock write, so the emulator never waits on readers
+ * and reads never make a syscall.
+ */
+class StateExport {
+public:
+    StateExport();
+    ~StateExport();
+
+    // emulator side, the segment is removed again on destruction
+    bool Create(const char* name);
+    void Publish(const Chip8& chip8, uint64_t frame);
+
+    // reader side
+    bool Attach(const char* name);
+    bool Read(Chip8State& state, uint64_t& frame) const;
+
+private:
+    bool Map(const char* name, bool writable);
+
+    ExportedState* shared;
+    std::string name; // set while we own the segment
+};
+
+#endif
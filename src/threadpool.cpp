@@ -0,0 +1,110 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned int threads) : queued(0), unfinished(0), nextWorker(0), stopping(false) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.emplace_back(new Worker());
+    }
+
+    for (unsigned int i = 0; i < threads; i++) {
+        this->threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+/**
+ * Queue a task on the next worker in turn.
+ */
+void ThreadPool::Submit(std::function<void()> task) {
+    unsigned int target;
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        unfinished++;
+        queued++;
+        target = nextWorker;
+        nextWorker = (nextWorker + 1) % workers.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(workers[target]->lock);
+        workers[target]->tasks.push_back(std::move(task));
+    }
+
+    workAvailable.notify_one();
+}
+
+/**
+ * Block until every submitted task has finished.
+ */
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> guard(stateLock);
+    allDone.wait(guard, [this] { return unfinished == 0; });
+}
+
+/**
+ * Take a task from our own deque, or steal one from another worker.
+ */
+bool ThreadPool::Pop(unsigned int self, std::function<void()>& task) {
+    {
+        Worker& own = *workers[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (unsigned int i = 1; i < workers.size(); i++) {
+        Worker& victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned int self) {
+    while (true) {
+        std::function<void()> task;
+
+        if (Pop(self, task)) {
+            queued--;
+            task();
+
+            std::lock_guard<std::mutex> guard(stateLock);
+            if (--unfinished == 0) {
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        // nothing to run or steal, sleep until more work arrives
+        std::unique_lock<std::mutex> guard(stateLock);
+        workAvailable.wait(guard, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
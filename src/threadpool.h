@@ -0,0 +1,51 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work-stealing thread pool.
+ * Every worker owns a deque. Submitted tasks are spread over the deques;
+ * a worker pops from the back of its own deque and, once that is empty,
+ * steals from the front of the others.
+ */
+class ThreadPool {
+public:
+    ThreadPool(unsigned int threads = 0); // 0 = one per hardware thread
+    ~ThreadPool();
+
+    void Submit(std::function<void()> task);
+    void Wait();
+
+    unsigned int Size() const { return workers.size(); }
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool Pop(unsigned int self, std::function<void()>& task);
+    void WorkerLoop(unsigned int self);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex stateLock;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+
+    std::atomic<size_t> queued;  // tasks waiting in a deque
+    size_t unfinished;           // tasks submitted but not finished, guarded by stateLock
+    unsigned int nextWorker;     // round-robin submission, guarded by stateLock
+    bool stopping;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "trace.h"
+
+#include <chrono>
+
+Trace::Trace(FILE* output) : output(output), level(TRACE_OFF), running(true), head(0), tail(0), dropped(0) {
+    worker = std::thread(&Trace::Drain, this);
+}
+
+Trace::~Trace() {
+    running.store(false, std::memory_order_release);
+    worker.join();
+
+    uint64_t lost = dropped.load(std::memory_order_relaxed);
+    if (lost > 0) {
+        fprintf(output, "Trace: %llu records dropped\n", (unsigned long long) lost);
+    }
+    fflush(output);
+}
+
+/**
+ * Set the trace level. Safe to call while the emulator is running.
+ */
+void Trace::SetLevel(TraceLevel level) {
+    this->level.store(level, std::memory_order_relaxed);
+}
+
+/**
+ * Drain thread main loop.
+ * Sleeps briefly when the ring is empty and exits once the
+ * trace is destroyed and every pending record has been written.
+ */
+void Trace::Drain() {
+    while (true) {
+        bool wrote = DrainPending();
+
+        if (!running.load(std::memory_order_acquire)) {
+            DrainPending();
+            break;
+        }
+
+        if (!wrote) {
+            fflush(output);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+/**
+ * Decode and write every record currently in the ring.
+ * Returns true if anything was written.
+ */
+bool Trace::DrainPending() {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+
+    if (t == h) {
+        return false;
+    }
+
+    bool registers = GetLevel() >= TRACE_REGISTERS;
+
+    for (; t != h; t++) {
+        const TraceRecord& r = buffer[t & (TRACE_BUFFER_SIZE - 1)];
+        char instr[DISASSEMBLY_MNEMONIC_MAX];
+        disassembler.formatOpcode(r.opcode, instr);
+
+        if (registers) {
+            fprintf(output, "%03x: %04x | %-20s I=%03x SP=%d\n", r.pc, r.opcode, instr, r.I, r.sp);
+        } else {
+            fprintf(output, "%03x: %04x | %s\n", r.pc, r.opcode, instr);
+        }
+    }
+
+    // hand the slots back to the emulator
+    tail.store(t, std::memory_order_release);
+    return true;
+}
@@ -0,0 +1,86 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#include "../disassemble/disassembler.h"
+
+const unsigned int TRACE_BUFFER_SIZE = 1u << 16; // records, must be a power of two
+
+enum TraceLevel {
+    TRACE_OFF = 0,          // record nothing
+    TRACE_INSTRUCTIONS = 1, // pc, opcode and mnemonic
+    TRACE_REGISTERS = 2     // also I and sp
+};
+
+/* raw record written on the hot path, decoded later */
+struct TraceRecord {
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t I;
+    uint8_t sp;
+};
+
+/**
+ * Instruction trace.
+ * The emulator pushes raw records into a fixed-size single-producer,
+ * single-consumer ring. A background thread drains the ring and
+ * disassembles the records, so the emulation thread never formats
+ * or writes output. Records are dropped (and counted) if the ring is full.
+ */
+class Trace {
+public:
+    Trace(FILE* output = stdout);
+    ~Trace();
+
+    void SetLevel(TraceLevel level);
+    TraceLevel GetLevel() const { return level.load(std::memory_order_relaxed); }
+
+    /**
+     * Push a record. Called only from the emulation thread.
+     */
+    inline void Record(uint16_t pc, uint16_t opcode, uint16_t I, uint8_t sp) {
+        if (GetLevel() == TRACE_OFF) {
+            return;
+        }
+
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == TRACE_BUFFER_SIZE) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        buffer[h & (TRACE_BUFFER_SIZE - 1)] = {pc, opcode, I, sp};
+        head.store(h + 1, std::memory_order_release);
+    }
+
+private:
+    void Drain();
+    bool DrainPending();
+
+    FILE* output;
+    Disassembler disassembler;
+
+    std::atomic<TraceLevel> level;
+    std::atomic<bool> running;
+    std::thread worker;
+
+    alignas(64) std::atomic<uint32_t> head; // written by the emulator
+    alignas(64) std::atomic<uint32_t> tail; // written by the drain thread
+    alignas(64) std::atomic<uint64_t> dropped;
+
+    TraceRecord buffer[TRACE_BUFFER_SIZE];
+};
+
+/* compiles to nothing unless built with -DCHIP8_TRACE */
+#ifdef CHIP8_TRACE
+#define TRACE_RECORD(trace, pc, opcode, I, sp) \
+    do { if ((trace) != nullptr) { (trace)->Record((pc), (opcode), (I), (sp)); } } while (0)
+#else
+#define TRACE_RECORD(trace, pc, opcode, I, sp) do { } while (0)
+#endif
+
+#endif
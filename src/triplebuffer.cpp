@@ -0,0 +1,27 @@
+#include "triplebuffer.h"
+
+TripleBuffer::TripleBuffer() : back(0), front(1), middle(2) {
+    memset(frames, 0, sizeof(frames));
+}
+
+/**
+ * Hand the back frame to the consumer and take the old middle slot.
+ */
+void TripleBuffer::Publish() {
+    uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+    back = previous & INDEX_MASK;
+}
+
+/**
+ * Swap in the newest published frame.
+ * Returns false, leaving the front frame alone, if nothing new arrived.
+ */
+bool TripleBuffer::Acquire() {
+    if (!(middle.load(std::memory_order_acquire) & FRESH)) {
+        return false;
+    }
+
+    uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+    front = previous & INDEX_MASK;
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+#include "chip8.h"
+
+/**
+ * One published display frame.
+ */
+struct Frame {
+    uint64_t video[HIRES_VIDEO_HEIGHT][VIDEO_ROW_WORDS];
+    unsigned int width;
+    unsigned int height;
+    uint64_t dirtyRows; // rows changed since the previous published frame
+    uint64_t sequence; // publish count, a gap means frames were skipped
+    uint64_t inputSequence; // last key transition applied before the frame was emulated
+};
+
+/**
+ * Lock-free single-producer/single-consumer triple buffer.
+ * The producer fills the back frame and publishes it by swapping it with
+ * the middle slot. The consumer takes the middle slot only when it holds a
+ * frame it has not seen. Neither side ever waits; the consumer always gets
+ * the most recent frame and older unread ones are overwritten.
+ */
+class TripleBuffer {
+public:
+    TripleBuffer();
+
+    // producer
+    Frame& GetBack() { return frames[back]; }
+    void Publish();
+
+    // consumer
+    bool Acquire();
+    const Frame& GetFront() const { return frames[front]; }
+
+private:
+    static const uint8_t INDEX_MASK = 0x3;
+    static const uint8_t FRESH = 0x4; // middle holds an unread frame
+
+    Frame frames[3];
+
+    alignas(64) uint8_t back; // producer only
+    alignas(64) uint8_t front; // consumer only
+    alignas(64) std::atomic<uint8_t> middle; // slot index | FRESH
+};
+
+#endif
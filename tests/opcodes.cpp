@@ -0,0 +1,253 @@
+#include "chip8.h"
+
+#include <cstdio>
+#include <vector>
+
+/*
+ * Opcode conformance tests for the interpreter.
+ *
+ * make check builds this once per dispatch policy (table, switch, goto).
+ * Each case loads a short program, runs it for a number of instructions,
+ * once with superinstructions and once without, and compares the listed
+ * registers, memory and pixels with their expected values.
+ */
+
+enum Field {
+    FIELD_V,
+    FIELD_I,
+    FIELD_PC,
+    FIELD_SP,
+    FIELD_STACK,
+    FIELD_DT,
+    FIELD_ST,
+    FIELD_MEMORY,
+    FIELD_PIXEL,
+    FIELD_FLAG, // RPL user flag
+    FIELD_HIRES,
+    FIELD_HALTED
+};
+
+struct Expect {
+    Field field;
+    unsigned int index; // register, address or pixel, where the field has one
+    unsigned int value;
+};
+
+static Expect V(unsigned int x, unsigned int value) { return {FIELD_V, x, value}; }
+static Expect Index(unsigned int value) { return {FIELD_I, 0, value}; }
+static Expect PC(unsigned int value) { return {FIELD_PC, 0, value}; }
+static Expect SP(unsigned int value) { return {FIELD_SP, 0, value}; }
+static Expect Stack(unsigned int level, unsigned int value) { return {FIELD_STACK, level, value}; }
+static Expect DT(unsigned int value) { return {FIELD_DT, 0, value}; }
+static Expect ST(unsigned int value) { return {FIELD_ST, 0, value}; }
+static Expect Memory(unsigned int address, unsigned int value) { return {FIELD_MEMORY, address, value}; }
+static Expect Pixel(unsigned int x, unsigned int y, bool on) { return {FIELD_PIXEL, y * HIRES_VIDEO_WIDTH + x, on}; }
+static Expect Flag(unsigned int i, unsigned int value) { return {FIELD_FLAG, i, value}; }
+static Expect HighRes(bool on) { return {FIELD_HIRES, 0, on}; }
+static Expect Halted(bool on) { return {FIELD_HALTED, 0, on}; }
+
+struct OpcodeTest {
+    const char* name;
+    std::vector<uint16_t> program; // big-endian words from 0x200, instructions or data
+    uint32_t instructions; // to run
+    std::vector<Expect> expects;
+    uint16_t keys = 0; // bit k set while key k is down
+};
+
+// 16x16 sprite for Dxy0: a full top row, then a hollow row
+static const std::vector<uint16_t> BIG_SPRITE = {0xFFFF, 0x8001, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+static std::vector<uint16_t> Concat(std::vector<uint16_t> code, const std::vector<uint16_t>& data) {
+    code.insert(code.end(), data.begin(), data.end());
+    return code;
+}
+
+static const OpcodeTest TESTS[] = {
+    // display
+    {"00E0 clears the display", {0x6000, 0xF029, 0xD005, 0x00E0}, 4, {Pixel(0, 0, false), Pixel(3, 1, false)}},
+    {"00Cn scrolls down", {0x6000, 0xF029, 0xD005, 0x00C2}, 4,
+     {Pixel(0, 0, false), Pixel(1, 2, true), Pixel(1, 3, false), Pixel(3, 3, true)}},
+    {"00FB scrolls right", {0x6000, 0xF029, 0xD005, 0x00FB}, 4,
+     {Pixel(0, 0, false), Pixel(4, 0, true), Pixel(7, 0, true), Pixel(8, 0, false)}},
+    {"00FC scrolls left", {0x6008, 0x6100, 0xA050, 0xD015, 0x00FC}, 5,
+     {Pixel(4, 0, true), Pixel(7, 0, true), Pixel(8, 0, false)}},
+    {"00FF switches to high resolution", {0x00FF}, 1, {HighRes(true)}},
+    {"00FE switches back to low resolution", {0x00FF, 0x00FE}, 2, {HighRes(false)}},
+    {"Dxyn draws a font sprite", {0x6000, 0xF029, 0xD005}, 3,
+     {Pixel(0, 0, true), Pixel(3, 0, true), Pixel(4, 0, false), Pixel(1, 1, false), Pixel(3, 1, true), V(0xF, 0)}},
+    {"Dxyn XORs and reports collisions", {0x6000, 0xF029, 0xD005, 0xD005}, 4, {Pixel(0, 0, false), V(0xF, 1)}},
+    {"Dxyn wraps the start position", {0x6046, 0x6121, 0xA050, 0xD015}, 4, {Pixel(6, 1, true), Pixel(9, 1, true)}},
+    {"Dxyn clips at the right edge", {0x603E, 0x6100, 0xA050, 0xD015}, 4,
+     {Pixel(62, 0, true), Pixel(63, 0, true), Pixel(0, 0, false), Pixel(1, 0, false)}},
+    {"Dxyn clips at the bottom edge", {0x6000, 0x611E, 0xA050, 0xD015}, 4,
+     {Pixel(0, 30, true), Pixel(0, 31, true), Pixel(0, 0, false), Pixel(0, 1, false)}},
+    {"Dxyn draws across both words in high resolution", {0x00FF, 0x603E, 0x6100, 0xA050, 0xD015}, 5,
+     {Pixel(62, 0, true), Pixel(65, 0, true), Pixel(66, 0, false)}},
+    {"Dxy0 draws a 16x16 sprite", Concat({0x00FF, 0x6000, 0x6100, 0xA20C, 0xD010, 0x120A}, BIG_SPRITE), 5,
+     {Pixel(0, 0, true), Pixel(15, 0, true), Pixel(16, 0, false), Pixel(0, 1, true), Pixel(1, 1, false),
+      Pixel(15, 1, true), V(0xF, 0)}},
+    {"00FD halts on the EXIT", {0x6001, 0x00FD, 0x6002}, 3, {Halted(true), PC(0x202), V(0, 1)}},
+
+    // flow
+    {"1nnn jumps", {0x1206, 0x6001, 0x6001, 0x6102}, 2, {V(0, 0), V(1, 2), PC(0x208)}},
+    {"2nnn calls", {0x2206, 0x6101, 0x1204, 0x6005, 0x00EE}, 1, {PC(0x206), SP(1), Stack(0, 0x202)}},
+    {"00EE returns", {0x2206, 0x6101, 0x1204, 0x6005, 0x00EE}, 4, {V(0, 5), V(1, 1), SP(0), PC(0x204)}},
+    {"Bnnn jumps by V0", {0x6004, 0xB206}, 2, {PC(0x20A)}},
+    {"3xkk skips when equal", {0x6005, 0x3005, 0x6101, 0x6202}, 3, {V(1, 0), V(2, 2)}},
+    {"3xkk runs on when different", {0x6005, 0x3004, 0x6101}, 3, {V(1, 1)}},
+    {"4xkk skips when different", {0x6005, 0x4004, 0x6101, 0x6202}, 3, {V(1, 0), V(2, 2)}},
+    {"4xkk runs on when equal", {0x6005, 0x4005, 0x6101}, 3, {V(1, 1)}},
+    {"5xy0 skips when equal", {0x6005, 0x6105, 0x5010, 0x6201, 0x6302}, 4, {V(2, 0), V(3, 2)}},
+    {"9xy0 skips when different", {0x6005, 0x6106, 0x9010, 0x6201, 0x6302}, 4, {V(2, 0), V(3, 2)}},
+    {"9xy0 runs on when equal", {0x6005, 0x6105, 0x9010, 0x6201}, 4, {V(2, 1)}},
+
+    // arithmetic
+    {"6xkk loads", {0x6A42}, 1, {V(0xA, 0x42)}},
+    {"7xkk adds without carry", {0x60FF, 0x7002}, 2, {V(0, 0x01), V(0xF, 0)}},
+    {"8xy0 copies", {0x6107, 0x8010}, 2, {V(0, 7)}},
+    {"8xy1 ORs", {0x600C, 0x610A, 0x8011}, 3, {V(0, 0x0E)}},
+    {"8xy2 ANDs", {0x600C, 0x610A, 0x8012}, 3, {V(0, 0x08)}},
+    {"8xy3 XORs", {0x600C, 0x610A, 0x8013}, 3, {V(0, 0x06)}},
+    {"8xy4 adds", {0x6010, 0x6120, 0x8014}, 3, {V(0, 0x30), V(0xF, 0)}},
+    {"8xy4 carries", {0x60FF, 0x6102, 0x8014}, 3, {V(0, 0x01), V(0xF, 1)}},
+    {"8xy5 subtracts", {0x6005, 0x6103, 0x8015}, 3, {V(0, 0x02), V(0xF, 1)}},
+    {"8xy5 borrows", {0x6003, 0x6105, 0x8015}, 3, {V(0, 0xFE), V(0xF, 0)}},
+    {"8xy6 shifts right", {0x6005, 0x8006}, 2, {V(0, 0x02), V(0xF, 1)}},
+    {"8xy7 subtracts from Vy", {0x6003, 0x6105, 0x8017}, 3, {V(0, 0x02), V(0xF, 1)}},
+    {"8xy7 borrows", {0x6005, 0x6103, 0x8017}, 3, {V(0, 0xFE), V(0xF, 0)}},
+    {"8xyE shifts left", {0x6081, 0x800E}, 2, {V(0, 0x02), V(0xF, 1)}},
+    {"Cxkk masks the random byte", {0x60FF, 0xC000}, 2, {V(0, 0)}},
+
+    // index and memory
+    {"Annn loads I", {0xA123}, 1, {Index(0x123)}},
+    {"Fx1E adds to I", {0xA100, 0x6005, 0xF01E}, 3, {Index(0x105)}},
+    {"Fx29 points at a digit", {0x600A, 0xF029}, 2, {Index(FONTSET_START_ADDRESS + 10 * FONT_SIZE)}},
+    {"Fx30 points at a big digit", {0x6003, 0xF030}, 2, {Index(BIG_FONTSET_START_ADDRESS + 3 * BIG_FONT_SIZE)}},
+    {"Fx33 stores BCD", {0x609C, 0xA300, 0xF033}, 3, {Memory(0x300, 1), Memory(0x301, 5), Memory(0x302, 6)}},
+    {"Fx55 stores V0 to Vx", {0x6011, 0x6122, 0x6233, 0xA300, 0xF155}, 5,
+     {Memory(0x300, 0x11), Memory(0x301, 0x22), Memory(0x302, 0x00), Index(0x300)}},
+    {"Fx65 loads V0 to Vx", {0xA208, 0xF165, 0x1204, 0x0000, 0xABCD}, 2, {V(0, 0xAB), V(1, 0xCD), V(2, 0), Index(0x208)}},
+    {"Fx55 rewrites code that runs next", {0x6061, 0x6199, 0xA20A, 0xF055, 0x6300, 0x6277}, 6, {V(1, 0x77), V(2, 0)}},
+    {"Fx75 and Fx85 keep the RPL flags", {0x6011, 0x6122, 0xF175, 0x6000, 0x6100, 0xF185}, 6,
+     {V(0, 0x11), V(1, 0x22), Flag(0, 0x11), Flag(1, 0x22)}},
+
+    // timers
+    {"Fx15 sets the delay timer", {0x6033, 0xF015}, 2, {DT(0x33)}},
+    {"Fx18 sets the sound timer", {0x6033, 0xF018}, 2, {ST(0x33)}},
+    {"Fx07 reads the delay timer", {0x6020, 0xF015, 0xF107}, 3, {V(1, 0x20)}},
+
+    // keys
+    {"Ex9E skips when pressed", {0x6005, 0xE09E, 0x6101, 0x6202}, 3, {V(1, 0), V(2, 2)}, 1u << 5},
+    {"Ex9E runs on when released", {0x6005, 0xE09E, 0x6101}, 3, {V(1, 1)}},
+    {"ExA1 skips when released", {0x6005, 0xE0A1, 0x6101, 0x6202}, 3, {V(1, 0), V(2, 2)}},
+    {"ExA1 runs on when pressed", {0x6005, 0xE0A1, 0x6101}, 3, {V(1, 1)}, 1u << 5},
+    {"Fx0A waits for a key", {0xF30A, 0x6101}, 10, {PC(0x200), V(1, 0), V(3, 0)}},
+    {"Fx0A waits for the key to go up", {0xF30A, 0x6101}, 10, {PC(0x200), V(1, 0), V(3, 0)}, 1u << 7},
+
+    // idioms the decoder fuses, and idle loops skipped whole
+    {"6xkk x3", {0x6001, 0x6102, 0x6203}, 3, {V(0, 1), V(1, 2), V(2, 3)}},
+    {"7xkk; 3xkk counting loop", {0x6000, 0x7001, 0x300A, 0x1202, 0x6101}, 31, {V(0, 10), V(1, 1), PC(0x20A)}},
+    {"7xkk; 4xkk counting loop", {0x6000, 0x7001, 0x400A, 0x120A, 0x1202, 0x6101}, 32, {V(0, 10), V(1, 1), PC(0x20C)}},
+    {"Fx07; 3xkk; 1nnn timer wait", {0x6005, 0xF015, 0xF107, 0x3100, 0x1204}, 100, {V(1, 5), PC(0x208)}},
+    {"Fx07; 4xkk; 1nnn timer wait", {0x6005, 0xF015, 0xF107, 0x4105, 0x1204}, 100, {V(1, 5), PC(0x208)}},
+    {"Ex9E; 1nnn key wait", {0x6005, 0xE09E, 0x1202}, 11, {PC(0x202)}},
+    {"ExA1; 1nnn key wait", {0x6005, 0xE0A1, 0x1202}, 11, {PC(0x202)}, 1u << 5},
+};
+
+static unsigned int Actual(const Chip8State& state, const Expect& expect) {
+    switch (expect.field) {
+        case FIELD_V: return state.V[expect.index];
+        case FIELD_I: return state.I;
+        case FIELD_PC: return state.pc;
+        case FIELD_SP: return state.sp;
+        case FIELD_STACK: return state.stack[expect.index];
+        case FIELD_DT: return state.delayTimer;
+        case FIELD_ST: return state.soundTimer;
+        case FIELD_MEMORY: return state.memory[expect.index];
+        case FIELD_PIXEL: {
+            unsigned int x = expect.index % HIRES_VIDEO_WIDTH;
+            unsigned int y = expect.index / HIRES_VIDEO_WIDTH;
+            return (state.video[y][x / 64] >> (63 - x % 64)) & 1u;
+        }
+        case FIELD_FLAG: return state.rplFlags[expect.index];
+        case FIELD_HIRES: return state.highRes;
+        case FIELD_HALTED: return state.halted;
+    }
+
+    return 0;
+}
+
+static void Describe(const Expect& expect, char* out, size_t size) {
+    static const char* const names[] = {"V", "I", "pc", "sp", "stack", "DT", "ST", "memory", "pixel", "flag", "hires", "halted"};
+
+    switch (expect.field) {
+        case FIELD_V: snprintf(out, size, "V%X", expect.index); break;
+        case FIELD_STACK: case FIELD_FLAG: snprintf(out, size, "%s[%u]", names[expect.field], expect.index); break;
+        case FIELD_MEMORY: snprintf(out, size, "memory[%03X]", expect.index); break;
+        case FIELD_PIXEL:
+            snprintf(out, size, "pixel(%u, %u)", expect.index % HIRES_VIDEO_WIDTH, expect.index / HIRES_VIDEO_WIDTH);
+            break;
+        default: snprintf(out, size, "%s", names[expect.field]); break;
+    }
+}
+
+/**
+ * Run one case. Returns the number of failed expectations.
+ */
+static int RunTest(const OpcodeTest& test, bool fusion) {
+    std::vector<uint8_t> program;
+    for (uint16_t word : test.program) {
+        program.push_back(word >> 8);
+        program.push_back(word & 0xFF);
+    }
+
+    Chip8 chip8;
+    chip8.SetSeed(0);
+    chip8.SetFusion(fusion);
+    chip8.LoadProgram(program.data(), program.size());
+
+    for (unsigned int key = 0; key < 16; key++) {
+        chip8.keypad[key] = (test.keys >> key) & 1u;
+    }
+
+    uint32_t executed = chip8.Run(test.instructions);
+
+    Chip8State state;
+    chip8.SaveState(state);
+
+    const char* mode = fusion ? "fused" : "unfused";
+    int failures = 0;
+
+    if (executed != test.instructions && !state.halted) {
+        printf("FAIL %s (%s, %s): ran %u instructions, expected %u\n", test.name, DISPATCH_NAMES[CHIP8_DISPATCH], mode,
+               executed, test.instructions);
+        failures++;
+    }
+
+    for (const Expect& expect : test.expects) {
+        unsigned int actual = Actual(state, expect);
+        if (actual != expect.value) {
+            char field[32];
+            Describe(expect, field, sizeof(field));
+            printf("FAIL %s (%s, %s): %s = %X, expected %X\n", test.name, DISPATCH_NAMES[CHIP8_DISPATCH], mode, field,
+                   actual, expect.value);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    unsigned int count = sizeof(TESTS) / sizeof(TESTS[0]);
+
+    for (const OpcodeTest& test : TESTS) {
+        failures += RunTest(test, true);
+        failures += RunTest(test, false);
+    }
+
+    printf("opcodes (%s dispatch): %u cases, %d failures\n", DISPATCH_NAMES[CHIP8_DISPATCH], count, failures);
+
+    return failures > 0 ? 1 : 0;
+}